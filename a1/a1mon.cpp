@@ -1,18 +1,51 @@
 #include <iostream>
-#include <sstream>
-#include <iterator>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string>
 #include <vector>
 #include <map>
 #include <set>
-#include <unistd.h> // sleep, getpid
+#include <unistd.h> // getpid, getuid, sysconf
 #include <sys/resource.h>
 #include <signal.h> //kill
+#include <algorithm>
+#include <dirent.h>   // opendir, readdir
+#include <fcntl.h>    // openat
+#include <sys/stat.h> // fstatat
+#include <pwd.h>      // getpwuid
+#include <time.h>     // nanosleep, localtime_r
+#include <string.h>
+#include <errno.h>
+#include <sys/epoll.h>   // epoll_create1, epoll_wait
+#include <sys/socket.h>
+#include <sys/syscall.h> // SYS_pidfd_open
+#include <linux/netlink.h>
+#include <linux/connector.h>
+#include <linux/cn_proc.h>
+
+#define PROCBUF 4096     // bytes of /proc/[pid]/stat and cmdline read per process
+#define EVENTBUF 65536   // bytes of proc connector messages read at once
+#define NLRCVBUF (1 << 20) // socket receive buffer, so bursts of forks are not dropped
+#define LATEFORKMSEC 50  // msec to wait for forks that raced with the cleanup
 
 using namespace std;
 
+// one process of the user as read from /proc
+struct processSample
+{
+    pid_t pid;
+    pid_t ppid;
+    char state;
+    unsigned long long startTicks; // clock ticks after boot the process started at
+    string cmd;
+};
+
+// the samples are kept between intervals so their strings are reused
+vector<processSample> samples;
+vector<int> sampleOrder;
+int sampleCount = 0;
+char procBuf[PROCBUF];
+
 // displays a list of all running processes
 void displayMonitoredProcessList(map<pid_t, string> processCommand)
 {
@@ -53,13 +86,245 @@ void killAllChildProcesses(pid_t targetPid, map<pid_t, set<pid_t>> parentChild,
     }
 }
 
+// reads a small /proc file into procBuf, returns the number of bytes read or -1
+// /proc returns everything it has in one read, so a short read is the end of the file
+int readProcFile(int procfd, const char *path)
+{
+    int fd = openat(procfd, path, O_RDONLY);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    int total = 0;
+    int n;
+    while (total < PROCBUF - 1 && (n = read(fd, procBuf + total, PROCBUF - 1 - total)) > 0)
+    {
+        total += n;
+        if (n < PROCBUF - 1 - (total - n))
+        {
+            break;
+        }
+    }
+    close(fd);
+    procBuf[total] = '\0';
+    return total;
+}
+
+// reads a /proc/[pid]/cmdline into procBuf as one line, returns its length or -1
+int readCommandLine(int procfd, const char *path)
+{
+    int n = readProcFile(procfd, path);
+    // the arguments are separated by nulls, other control characters are shown as ? like ps does
+    while (n > 0 && procBuf[n - 1] == '\0')
+    {
+        n--;
+    }
+    for (int i = 0; i < n; ++i)
+    {
+        if (procBuf[i] == '\0')
+        {
+            procBuf[i] = ' ';
+        }
+        else if ((unsigned char) procBuf[i] < ' ')
+        {
+            procBuf[i] = '?';
+        }
+    }
+    return n;
+}
+
+// returns the boot time in seconds since the epoch from the btime line of /proc/stat
+time_t bootTime()
+{
+    int fd = open("/proc/stat", O_RDONLY);
+    if (fd < 0)
+    {
+        return 0;
+    }
+    // btime is after the cpu lines, which can take more than one buffer on large machines
+    string stat;
+    int n;
+    while ((n = read(fd, procBuf, PROCBUF)) > 0)
+    {
+        stat.append(procBuf, n);
+    }
+    close(fd);
+    size_t at = stat.find("\nbtime ");
+    return at == string::npos ? 0 : atol(stat.c_str() + at + 7);
+}
+
+// reads one /proc/[pid] entry into sample, returns false if it is not a process of uid
+// or it exited while being read
+bool readProcess(int procfd, const char *name, uid_t uid, processSample &sample)
+{
+    struct stat info;
+    if (fstatat(procfd, name, &info, 0) < 0 || info.st_uid != uid)
+    {
+        return false;
+    }
+    char path[64];
+    snprintf(path, sizeof(path), "%s/stat", name);
+
+    // the command name is in parentheses and may itself contain spaces and parentheses
+    bool parsed = false;
+    char *nameStart, *nameEnd;
+    if (readProcFile(procfd, path) > 0 && (nameStart = strchr(procBuf, '(')) != NULL &&
+        (nameEnd = strrchr(procBuf, ')')) != NULL)
+    {
+        sample.pid = atoi(procBuf);
+        // fields 3 and 4 are the state and parent, field 22 is the start time
+        parsed = sscanf(nameEnd + 2, "%c %d %*d %*d %*d %*d %*u %*u %*u %*u %*u %*u %*u %*d %*d %*d %*d %*d %*d %llu",
+                      &sample.state, &sample.ppid, &sample.startTicks) == 3;
+        // kernel threads and zombies have no command line and are shown as [name] like ps does
+        sample.cmd.assign("[");
+        sample.cmd.append(nameStart + 1, nameEnd - nameStart - 1);
+        sample.cmd.append("]");
+    }
+    int n;
+    snprintf(path, sizeof(path), "%s/cmdline", name);
+    if (parsed && (n = readCommandLine(procfd, path)) > 0)
+    {
+        sample.cmd.assign(procBuf, n);
+    }
+    return parsed;
+}
+
+// reads every process of uid from /proc into samples, sorted by start time like ps --sort start
+// returns false if /proc can not be read
+bool sampleProcesses(uid_t uid)
+{
+    DIR *proc = opendir("/proc");
+    if (proc == NULL)
+    {
+        return false;
+    }
+    int procfd = dirfd(proc);
+    sampleCount = 0;
+    struct dirent *entry;
+    while ((entry = readdir(proc)) != NULL)
+    {
+        if (entry->d_name[0] < '0' || entry->d_name[0] > '9')
+        {
+            continue;
+        }
+        if (sampleCount == samples.size())
+        {
+            samples.push_back(processSample());
+        }
+        if (readProcess(procfd, entry->d_name, uid, samples[sampleCount]))
+        {
+            sampleCount++;
+        }
+    }
+    closedir(proc);
+
+    sampleOrder.resize(sampleCount);
+    for (int i = 0; i < sampleCount; ++i)
+    {
+        sampleOrder[i] = i;
+    }
+    sort(sampleOrder.begin(), sampleOrder.end(), [](int a, int b) {
+        return samples[a].startTicks < samples[b].startTicks ||
+               (samples[a].startTicks == samples[b].startTicks && samples[a].pid < samples[b].pid);
+    });
+    return true;
+}
+
+// formats the start time of a process the way ps does: the time of day if it started in the
+// last day, otherwise the month and day
+void formatStart(unsigned long long startTicks, time_t boot, long ticksPerSec, time_t now, char start[16])
+{
+    time_t started = boot + startTicks / ticksPerSec;
+    struct tm local;
+    localtime_r(&started, &local);
+    strftime(start, 16, now - started < 24 * 60 * 60 ? "%H:%M:%S" : "%b %d", &local);
+}
+
+// sleeps for interval seconds, which may be a fraction of a second
+void sleepInterval(double interval)
+{
+    struct timespec delay;
+    delay.tv_sec = (time_t) interval;
+    delay.tv_nsec = (long) ((interval - delay.tv_sec) * 1e9);
+    while (nanosleep(&delay, &delay) < 0 && errno == EINTR)
+    {
+    }
+}
+
+// the user and clock samples are displayed with, they do not change while monitoring
+uid_t uid;
+string userName;
+time_t boot;
+long ticksPerSec;
+
+void initSampling()
+{
+    uid = getuid();
+    struct passwd *user = getpwuid(uid);
+    userName = user != NULL ? user->pw_name : to_string(uid);
+    boot = bootTime();
+    ticksPerSec = sysconf(_SC_CLK_TCK);
+}
+
+// prints the header of an interval and a new sample of the user processes, and stores the
+// children and command of each process in the maps
+// returns false if /proc can not be read
+bool displaySample(int counter, pid_t pid, pid_t targetPid, double interval,
+                   map<pid_t, set<pid_t>> &parentChild, map<pid_t, string> &processCommand)
+{
+    // print out the header
+    cout << "===================================" << endl
+         << "a1mon ["
+         << "counter= " << counter << ", "
+         << "pid= " << pid << ", "
+         << "target_pid= " << targetPid << ", "
+         << "interval= " << interval << " sec]: " << endl
+         << endl;
+
+    // get the status of the user processes
+    if (!sampleProcesses(uid))
+    {
+        cout << "Unable to read /proc." << endl;
+        return false;
+    }
+
+    // empty the current maps
+    parentChild.clear();
+    processCommand.clear();
+
+    // print the sample in the same columns as ps -o user,pid,ppid,state,start,cmd
+    static char line[PROCBUF + 64];
+    time_t now = time(NULL);
+    char start[16];
+    snprintf(line, sizeof(line), "%-8s %7s %7s %c %8s %s\n", "USER", "PID", "PPID", 'S', "STARTED", "CMD");
+    cout << line;
+    for (int i = 0; i < sampleCount; ++i)
+    {
+        processSample &sample = samples[sampleOrder[i]];
+        formatStart(sample.startTicks, boot, ticksPerSec, now, start);
+        snprintf(line, sizeof(line), "%-8.8s %7d %7d %c %8s %s\n", userName.c_str(), sample.pid, sample.ppid,
+                 sample.state, start, sample.cmd.c_str());
+        cout << line;
+
+        // map the parent to its child
+        parentChild[sample.ppid].insert(sample.pid);
+
+        // map the child to its command for display purposes
+        processCommand[sample.pid] = sample.cmd;
+    }
+
+    // display the list of processes we stored
+    displayMonitoredProcessList(processCommand);
+    return true;
+}
+
 // main monitoring function
 // prints out the status of all user processes
 // stores the information
 // determines if the target process is still running
-bool checkTargetProcess(pid_t targetPid, pid_t pid, int interval)
+// returns 0 once the target has terminated and been cleaned up, -1 if an error occurred
+int checkTargetProcess(pid_t targetPid, pid_t pid, double interval)
 {
-    FILE *fp;
     map<pid_t, set<pid_t>> parentChild;
     map<pid_t, string> processCommand;
     set<pid_t> targetProcessChildren;
@@ -69,104 +334,330 @@ bool checkTargetProcess(pid_t targetPid, pid_t pid, int interval)
         // keep track of the children of the target process so that
         // we know which processes to terminate once the target is terminated
         // if the target is terminated on the first iteration, we will have no information on its children
-        // since the parent of all its child processes will be set to 1 on the initial call to ps
+        // since the parent of all its child processes will be set to 1 on the first sample
         if (counter > 0)
         {
             targetProcessChildren = parentChild[targetPid];
         }
 
-        // print out the header
         counter += 1;
-        cout << "===================================" << endl
-             << "a1mon ["
-             << "counter= " << counter << ", "
-             << "pid= " << pid << ", "
-             << "target_pid= " << targetPid << ", "
-             << "interval= " << interval << " sec]: " << endl
-             << endl;
+        if (!displaySample(counter, pid, targetPid, interval, parentChild, processCommand))
+        {
+            return -1;
+        }
+
+        // the process is terminated if it is not in the sample
+        bool processTerminated = processCommand.find(targetPid) == processCommand.end();
 
-        // get the status of the user processes
-        if ((fp = popen("ps -u $USER -o user,pid,ppid,state,start,cmd --sort start", "r")) == NULL)
+        // kill all the child processes of the target process if it has been terminated
+        if (processTerminated)
         {
-            cout << "No target process ID found." << endl;
-            return 1;
+            cout << "a1mon: target appears to have terminated; cleaning up" << endl;
+            killAllChildProcesses(targetPid, parentChild, processCommand, targetProcessChildren);
+
+            cout << "exiting a1mon" << endl;
+            return 0;
         }
+        sleepInterval(interval);
+    } // end while
+
+    // should never get here
+    return -1;
+} // end getTargetProcess()
+
+// opens a pidfd for the target, which becomes readable when the target exits
+// returns -1 and sets errno if it can not be opened
+int openTargetPidfd(pid_t targetPid)
+{
+#ifdef SYS_pidfd_open
+    return syscall(SYS_pidfd_open, targetPid, 0);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
 
-        // empty the current maps
-        parentChild = map<pid_t, set<pid_t>>();
-        processCommand = map<pid_t, string>();
+// subscribes to the fork, exec and exit events of the kernel proc connector
+// returns the netlink socket, or -1 if it is not available
+// some kernels ignore the subscription of a user without CAP_NET_ADMIN, then no events come and
+// descendants are still found by sampling every interval
+int openProcConnector()
+{
+    int nlfd = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+    if (nlfd < 0)
+    {
+        return -1;
+    }
+    int size = NLRCVBUF;
+    setsockopt(nlfd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    struct sockaddr_nl address;
+    memset(&address, 0, sizeof(address));
+    address.nl_family = AF_NETLINK;
+    address.nl_groups = CN_IDX_PROC;
+    address.nl_pid = getpid();
 
-        // assume the process is terminated until locate it in the output from ps
-        bool processTerminated = true;
+    // a netlink header, a connector header and the listen operation
+    char message[NLMSG_SPACE(sizeof(struct cn_msg) + sizeof(enum proc_cn_mcast_op))];
+    memset(message, 0, sizeof(message));
+    struct nlmsghdr *header = (struct nlmsghdr *) message;
+    header->nlmsg_len = NLMSG_LENGTH(sizeof(struct cn_msg) + sizeof(enum proc_cn_mcast_op));
+    header->nlmsg_type = NLMSG_DONE;
+    header->nlmsg_pid = getpid();
+    struct cn_msg *connector = (struct cn_msg *) NLMSG_DATA(header);
+    connector->id.idx = CN_IDX_PROC;
+    connector->id.val = CN_VAL_PROC;
+    connector->len = sizeof(enum proc_cn_mcast_op);
+    *(enum proc_cn_mcast_op *) connector->data = PROC_CN_MCAST_LISTEN;
 
-        // parse the statuses into the maps
-        int MAXLINE = 1000;
-        char buf[MAXLINE];
-        int loopCounter = 0;
+    if (bind(nlfd, (struct sockaddr *) &address, sizeof(address)) < 0 ||
+        send(nlfd, message, header->nlmsg_len, 0) < 0)
+    {
+        close(nlfd);
+        return -1;
+    }
+    return nlfd;
+}
 
-        while (fgets(buf, MAXLINE, fp) != NULL)
+// adds every process in the maps that descends from the target or from a known descendant,
+// and drops known descendants that are no longer running
+void addSampledDescendants(pid_t targetPid, map<pid_t, set<pid_t>> &parentChild, map<pid_t, string> &processCommand,
+                           map<pid_t, string> &descendants)
+{
+    vector<pid_t> parents(1, targetPid);
+    for (map<pid_t, string>::iterator it = descendants.begin(); it != descendants.end();)
+    {
+        if (processCommand.find(it->first) == processCommand.end())
         {
-            cout << buf;
-            // ignore the first iteration as this is only headers
-            if (loopCounter < 1)
+            descendants.erase(it++);
+        }
+        else
+        {
+            parents.push_back(it->first);
+            ++it;
+        }
+    }
+    while (!parents.empty())
+    {
+        set<pid_t> &children = parentChild[parents.back()];
+        parents.pop_back();
+        for (set<pid_t>::iterator it = children.begin(); it != children.end(); ++it)
+        {
+            if (descendants.insert(make_pair(*it, processCommand[*it])).second)
             {
-                loopCounter++;
-                continue;
+                parents.push_back(*it);
             }
+        }
+    }
+}
 
-            // split the line from ps on spaces and place each word into a vector
-            string line(buf);
-            istringstream wordstream(line);
-            vector<string> words((istream_iterator<string>(wordstream)),
-                                 istream_iterator<string>());
-
-            pid_t childPid = atoi(words[1].c_str());
-            pid_t parentPid = atoi(words[2].c_str());
+// samples /proc again without displaying it and adds the descendants found
+void resampleDescendants(pid_t targetPid, map<pid_t, set<pid_t>> &parentChild, map<pid_t, string> &processCommand,
+                         map<pid_t, string> &descendants)
+{
+    if (!sampleProcesses(uid))
+    {
+        return;
+    }
+    parentChild.clear();
+    processCommand.clear();
+    for (int i = 0; i < sampleCount; ++i)
+    {
+        parentChild[samples[i].ppid].insert(samples[i].pid);
+        processCommand[samples[i].pid] = samples[i].cmd;
+    }
+    addSampledDescendants(targetPid, parentChild, processCommand, descendants);
+}
 
-            // if the child process id matches the target process id it is still running
-            if (childPid == targetPid)
+// reads the pending proc connector events and keeps descendants up to date: a process forked by
+// the target or a descendant is added, an exec updates its command and an exit removes it, so a
+// descendant stays known when its parent exits and it is reparented
+// when killing is set, a process forked by a descendant is killed as soon as it is seen
+// returns false if events were dropped because the socket buffer was full
+bool readProcEvents(int nlfd, pid_t targetPid, map<pid_t, string> &descendants, bool killing)
+{
+    static char buf[EVENTBUF] __attribute__((aligned(NLMSG_ALIGNTO)));
+    int n;
+    while ((n = recv(nlfd, buf, sizeof(buf), MSG_DONTWAIT)) > 0)
+    {
+        for (struct nlmsghdr *header = (struct nlmsghdr *) buf; NLMSG_OK(header, n); header = NLMSG_NEXT(header, n))
+        {
+            if (header->nlmsg_type != NLMSG_DONE)
             {
-                processTerminated = false;
+                continue;
             }
-
-            // map the parent to its child
-            parentChild[parentPid].insert(childPid);
-
-            // map the child to its command for display purposes
-            for (int i = 5; i < words.size(); ++i)
+            struct cn_msg *connector = (struct cn_msg *) NLMSG_DATA(header);
+            struct proc_event *event = (struct proc_event *) connector->data;
+            if (event->what == proc_event::PROC_EVENT_FORK)
             {
-                if (i == words.size() - 1)
+                // threads are forks too, only new processes have the same pid and tgid
+                pid_t parent = event->event_data.fork.parent_tgid;
+                pid_t child = event->event_data.fork.child_pid;
+                map<pid_t, string>::iterator it = descendants.find(parent);
+                if (child != event->event_data.fork.child_tgid || (parent != targetPid && it == descendants.end()))
+                {
+                    continue;
+                }
+                // a child of a descendant has its parent's command until it execs, the target's
+                // command is not kept so a child of the target is read from /proc
+                char path[64];
+                snprintf(path, sizeof(path), "/proc/%d/cmdline", child);
+                int length;
+                if (it != descendants.end())
                 {
-                    processCommand[childPid].append(words[i]);
+                    descendants[child] = it->second;
+                }
+                else if ((length = readCommandLine(AT_FDCWD, path)) > 0)
+                {
+                    descendants[child].assign(procBuf, length);
                 }
                 else
                 {
-                    processCommand[childPid].append(words[i]);
-                    processCommand[childPid].append(" ");
+                    descendants[child] = "";
+                }
+                if (killing)
+                {
+                    cout << "Terminating process: [" << child << ", " << descendants[child] << "]" << endl;
+                    kill(child, SIGKILL);
+                }
+            }
+            else if (event->what == proc_event::PROC_EVENT_EXEC)
+            {
+                map<pid_t, string>::iterator it = descendants.find(event->event_data.exec.process_tgid);
+                char path[64];
+                snprintf(path, sizeof(path), "/proc/%d/cmdline", it == descendants.end() ? 0 : it->first);
+                int length;
+                if (it != descendants.end() && (length = readCommandLine(AT_FDCWD, path)) > 0)
+                {
+                    it->second.assign(procBuf, length);
                 }
             }
-        } // end while
+            else if (event->what == proc_event::PROC_EVENT_EXIT &&
+                     event->event_data.exit.process_pid == event->event_data.exit.process_tgid)
+            {
+                descendants.erase(event->event_data.exit.process_tgid);
+            }
+        }
+    }
+    return !(n < 0 && errno == ENOBUFS);
+}
 
-        pclose(fp);
+// event driven monitoring function
+// prints out the status of all user processes every interval like checkTargetProcess, but waits
+// on a pidfd for the target so its descendants are cleaned up as soon as it exits, and keeps the
+// descendants up to date between samples with the proc connector when it is available
+// falls back to checkTargetProcess if the kernel has no pidfd_open
+// returns 0 once the target has terminated and been cleaned up, -1 if an error occurred
+int watchTargetProcess(pid_t targetPid, pid_t pid, double interval)
+{
+    int pidfd = openTargetPidfd(targetPid);
+    if (pidfd < 0 && errno == ESRCH)
+    {
+        cout << "a1mon: target is not running" << endl;
+        return 0;
+    }
+    if (pidfd < 0)
+    {
+        cout << "a1mon: pidfd_open is not available; sampling every interval instead" << endl;
+        return checkTargetProcess(targetPid, pid, interval);
+    }
 
-        // display the list of processes we stored
-        displayMonitoredProcessList(processCommand);
+    // subscribe before the first sample so no fork falls between them
+    int nlfd = openProcConnector();
+    if (nlfd < 0)
+    {
+        cout << "a1mon: proc connector is not available; descendants are found by sampling" << endl;
+    }
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event watch;
+    watch.events = EPOLLIN;
+    watch.data.fd = pidfd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, pidfd, &watch);
+    if (nlfd >= 0)
+    {
+        watch.data.fd = nlfd;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, nlfd, &watch);
+    }
 
-        // kill all the child processes of the target process if it has been terminated
-        if (processTerminated)
+    map<pid_t, set<pid_t>> parentChild;
+    map<pid_t, string> processCommand;
+    map<pid_t, string> descendants;
+    int counter = 0;
+    int status = 0;
+    bool processTerminated = false;
+    while (!processTerminated)
+    {
+        counter += 1;
+        if (!displaySample(counter, pid, targetPid, interval, parentChild, processCommand))
         {
-            cout << "a1mon: target appears to have terminated; cleaning up" << endl;
-            killAllChildProcesses(targetPid, parentChild, processCommand, targetProcessChildren);
-
-            cout << "exiting a1mon" << endl;
-            return processTerminated;
+            status = -1;
+            break;
         }
-        sleep(interval);
+        addSampledDescendants(targetPid, parentChild, processCommand, descendants);
+
+        // wait out the interval, handling events as they come
+        struct timespec now, end;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        long long endMsec = end.tv_sec * 1000LL + end.tv_nsec / 1000000 + (long long) (interval * 1000);
+        long long remaining;
+        do
+        {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            remaining = max(endMsec - (now.tv_sec * 1000LL + now.tv_nsec / 1000000), 0LL);
+            struct epoll_event events[2];
+            int ready = epoll_wait(epfd, events, 2, remaining);
+            for (int i = 0; i < ready; ++i)
+            {
+                processTerminated = processTerminated || events[i].data.fd == pidfd;
+            }
+            // events queued before the target exited are read before cleaning up
+            if (nlfd >= 0 && !readProcEvents(nlfd, targetPid, descendants, false))
+            {
+                // events were dropped, find the descendants again
+                resampleDescendants(targetPid, parentChild, processCommand, descendants);
+            }
+        } while (!processTerminated && remaining > 0);
     } // end while
 
-    // should never get here
-    return -1;
-} // end getTargetProcess()
+    if (processTerminated)
+    {
+        // without events, descendants forked since the last sample by a known descendant are only
+        // found by sampling again, children the target forked since then are already reparented
+        if (nlfd < 0)
+        {
+            resampleDescendants(targetPid, parentChild, processCommand, descendants);
+        }
+
+        // kill the descendants, then any they forked before they were killed
+        cout << "a1mon: target terminated; cleaning up" << endl;
+        for (map<pid_t, string>::iterator it = descendants.begin(); it != descendants.end(); ++it)
+        {
+            cout << "Terminating process: [" << it->first << ", " << it->second << "]" << endl;
+            kill(it->first, SIGKILL);
+        }
+        if (nlfd >= 0)
+        {
+            // the pidfd stays readable
+            epoll_ctl(epfd, EPOLL_CTL_DEL, pidfd, NULL);
+            struct epoll_event event;
+            while (epoll_wait(epfd, &event, 1, LATEFORKMSEC) > 0)
+            {
+                readProcEvents(nlfd, targetPid, descendants, true);
+            }
+        }
+    }
+    if (nlfd >= 0)
+    {
+        close(nlfd);
+    }
+    close(pidfd);
+    close(epfd);
+
+    if (processTerminated)
+    {
+        cout << "exiting a1mon" << endl;
+    }
+    return status;
+} // end watchTargetProcess()
 
 int main(int argc, char *argv[])
 {
@@ -180,19 +671,26 @@ int main(int argc, char *argv[])
     setrlimit(RLIMIT_CPU, &CPULimit);
 
     // get the user input arguments
-    int interval;
+    // a leading -e waits for the target's exit instead of sampling for it, see watchTargetProcess
+    bool eventDriven = argc > 1 && string(argv[1]) == "-e";
+    if (eventDriven)
+    {
+        argc--;
+        argv++;
+    }
+    double interval;
     pid_t targetPid;
     if (argc <= 1)
     {
         cout << "Missing argument: Target process ID" << endl;
         return 1;
     }
-    else if (argc >= 2 || argc <= 3)
+    else if (argc >= 2 && argc <= 3)
     {
         targetPid = atoi(argv[1]);
         if (argc == 3)
         {
-            interval = atoi(argv[2]);
+            interval = atof(argv[2]);
         }
         else
         {
@@ -206,9 +704,12 @@ int main(int argc, char *argv[])
     }
 
     // monitor the target's status
-    if (checkTargetProcess(targetPid, pid, interval) == -1)
+    initSampling();
+    int status = eventDriven ? watchTargetProcess(targetPid, pid, interval) : checkTargetProcess(targetPid, pid, interval);
+    if (status == -1)
     {
         cout << "An error occurred in monitoring target process" << endl;
+        return 1;
     }
     return 0;
 }
\ No newline at end of file
@@ -9,25 +9,59 @@ for packet code development
 #include "libraries.h"
 #include "constants.h"
 #include "packets.h"
+#include "flowtable.h"
+#include "pktpool.h"
+#include "swqueue.h"
+#include "metrics.h"
 
 // global variables
-queue<packet> packetQueue;              // queue comprised of queryRelayMessage type packets
+packetPool queuePool;                   // preallocated slots holding every queued packet
+packetList packetQueue;                 // switch: queue comprised of queryRelayMessage type packets waiting for a rule
+packetList linkQueues[MAX_NSW + 1];     // switch: packets waiting for each neighbouring switch's fifo to drain
+bool pausedLinks[MAX_NSW + 1];          // switch: neighbouring switches that have asked for a pause
+string fifoNames[MAX_NSW + 1][MAX_NSW + 1]; // fifo names by sender and receiver, created on first use
+queuePolicy switchQueuePolicy = TAILDROP; // switch: what to do when a queue is full
+bool upstreamPaused = false;            // switch: the neighbours have been asked to pause and the traffic file is on hold
+int neighbourSwitches[3] = {-1, -1, -1}; // switch: switch numbers on port1 and port2
 vector<message> connectionInfo;         // controller: switch table comprised of openMessage types
                                         // switch: flow table comprised of flowTableEntry types
                                          
+flowTableSoA flowTable;                 // switch: structure-of-arrays copy of the flow table used for classification
+classifyMode classifierMode;            // switch: classifier used, the decision tree once the flow table is large
 packetStats pktStats;                   // tracks the number of packets sent and received
-set< pair<bool, int> > pendingQuerySet; // used in switches to avoid sending duplicate queries
+queryTable sentQueries;                 // switch: queries sent to the controller, used to avoid sending duplicates
 int socketFileDescriptors[MAX_NSW + 1]; // the socket file descriptors, index 0 is not used in the controller
                                         // controller: index 0 is not used, every other index is set using switch number as index
                                         // switch: only index 0 is used for the controller socket descriptor
 
+vector<packet> queuedQueries;           // controller: queries that arrived before every switch connected
+vector<packet> pendingQueries;          // controller: queries waiting for the coalescing window to close
+struct timeval coalesceStartTime;       // controller: when the first pending query arrived
+int queryCoalesceMsec = QUERY_COALESCE_MSEC; // controller: length of the coalescing window, 0 disables it
+map<string, int> coalesceStats;         // controller: number of coalesced queries, computed routes and batches sent
+
+latencyHistogram queryLatency;          // switch: time from sending a QUERY to adding a rule that answers it
+vector<struct timeval> pendingQueryTimes; // controller: when each query in pendingQueries arrived
+latencyHistogram queryWaitLatency;      // controller: time a query waits in the coalescing window
+
 bool isSwitch;                          // used in printing and signal handling
 bool acknowledged = false;              // if a switch has been acknowledged by the controller
+int signalFileDescriptor = -1;          // signalfd that SIGUSR1 is delivered to
+int metricsFileDescriptor = -1;         // listening unix socket serving metrics snapshots, -1 if unavailable
+string metricsPath;                     // path of the metrics socket, removed on exit
+string processName;                     // "cont" or the switch name, used in the metrics
 // end global variables
 
+// result of writing a packet to a fifo without blocking
+enum writeResult {WRITE_OK, WRITE_BLOCKED, WRITE_FAILED};
+
 // function headers
 void processPacketQueue(int currSwitchNumber, int port1Switch = -2, int port2Switch = -2);
+void processQueryQueue(int currSwitchNumber);
 bool sendPacket(int sender, int receiver, packet outPacket);
+void flushLinkQueues(int currSwitchNumber);
+int queuedPacketCount();
+void countRelayWritten(int receiver, packet outPacket);
 // end function headers
 
 // prints information in connectionInfo for the controller
@@ -57,7 +91,7 @@ void listSwitchInfo()
         flowTableEntry ft = it->aMessage;
         cout << "[" << counter << "] (srcIP= "    << ft.srcIPLo  << "-" << ft.srcIPHi  <<
                                    ", destIP= "   << ft.destIPLo << "-" << ft.destIPHi << 
-                                   ", action= "   << ACTIONNAME[ft.actionType] << ":" << ft.actionVal <<
+                                   ", action= "   << actionString(ft) <<
                                    ", pri= "      << ft.pri <<
                                    ", pktCount= " << ft.pktCount << ")" << endl;
         counter += 1;
@@ -104,6 +138,49 @@ void listPacketStats()
         }
     }
     cout << endl; 
+
+    if (!isSwitch && queryCoalesceMsec > 0)
+    {
+        cout << "   Coalesced:   QUERY:" << coalesceStats["queries"] <<
+                              ", routes:" << coalesceStats["routes"] <<
+                              ", batches:" << coalesceStats["batches"] << endl;
+    }
+
+    if (isSwitch)
+    {
+        // per port transmit counters, used to monitor skew across ECMP ports
+        firstIteration = true;
+        cout << "   Port Tx:     ";
+        for (map<int, int>::iterator it = pktStats.portTransmitted.begin(); it != pktStats.portTransmitted.end(); ++it)
+        {
+            if (!firstIteration)
+            {
+                cout << ", ";
+            }
+            cout << "port" << it->first << ":" << it->second;
+            firstIteration = false;
+        }
+        cout << endl;
+
+        // drop counters for each reason, with the queue policy in use
+        firstIteration = true;
+        cout << "   Dropped:     ";
+        for (map<dropReason, int>::iterator it = pktStats.dropped.begin(); it != pktStats.dropped.end(); ++it)
+        {
+            if (!firstIteration)
+            {
+                cout << ", ";
+            }
+            cout << DROPREASONNAME[it->first] << ":" << it->second;
+            firstIteration = false;
+        }
+        cout << " (policy= " << QUEUEPOLICYNAME[switchQueuePolicy] << ", queued= " << queuedPacketCount() << ")" << endl;
+    }
+
+    // occupancy of the preallocated packet pool
+    cout << "   Pool:        inUse:" << queuePool.inUse << "/" << PACKET_POOL_SIZE <<
+                          ", highWater:" << queuePool.highWater <<
+                          ", exhausted:" << queuePool.exhausted << endl;
 }
 
 // list the information and the pktStats for either the switch or the controller
@@ -123,17 +200,143 @@ void listInfo()
     listPacketStats();
 }
 
-// the SIGUSR1 signal handler for both switch and controller
-void user1SignalHandler(int signo) 
+// reads the signals delivered to the signalfd and takes the appropriate action
+// SIGUSR1 is blocked and read here in the main loop, so listInfo never runs inside a signal handler
+void pollSignals()
 {
-    if (signo == SIGUSR1) 
+    struct signalfd_siginfo info;
+    while (read(signalFileDescriptor, &info, sizeof(info)) == sizeof(info))
     {
-        listInfo();
+        if (info.ssi_signo == SIGUSR1) 
+        {
+            listInfo();
+        }
+        else
+        {
+            cout << "Received signal: " << info.ssi_signo << ". Unable to handle this signal." << endl;
+        }
+    }
+}
+
+// creates the key=value metrics snapshot for either the switch or the controller
+string buildMetricsSnapshot()
+{
+    ostringstream snapshot;
+    snapshot << "name=" << processName << "\n";
+    snapshot << "role=" << (isSwitch ? "switch" : "controller") << "\n";
+    snapshot << "pid=" << getpid() << "\n";
+    for (map<packetType, int>::iterator it = pktStats.received.begin(); it != pktStats.received.end(); ++it)
+    {
+        snapshot << "received." << PACKETNAME[it->first] << "=" << it->second << "\n";
+    }
+    for (map<packetType, int>::iterator it = pktStats.transmitted.begin(); it != pktStats.transmitted.end(); ++it)
+    {
+        snapshot << "transmitted." << PACKETNAME[it->first] << "=" << it->second << "\n";
+    }
+
+    if (isSwitch)
+    {
+        for (map<int, int>::iterator it = pktStats.portTransmitted.begin(); it != pktStats.portTransmitted.end(); ++it)
+        {
+            snapshot << "port_tx.port" << it->first << "=" << it->second << "\n";
+        }
+        for (map<dropReason, int>::iterator it = pktStats.dropped.begin(); it != pktStats.dropped.end(); ++it)
+        {
+            snapshot << "dropped." << DROPREASONNAME[it->first] << "=" << it->second << "\n";
+        }
+        snapshot << "queue.policy=" << QUEUEPOLICYNAME[switchQueuePolicy] << "\n";
+        snapshot << "queue.waiting=" << packetQueue.size << "\n";
+        for (int port = 1; port <= 2; ++port)
+        {
+            int receiver = neighbourSwitches[port];
+            if (receiver > 0)
+            {
+                snapshot << "queue.link.sw" << receiver << "=" << linkQueues[receiver].size << "\n";
+                snapshot << "queue.link.sw" << receiver << ".paused=" << pausedLinks[receiver] << "\n";
+            }
+        }
+        snapshot << "queue.upstream_paused=" << upstreamPaused << "\n";
+        snapshot << "flow_table.rules=" << connectionInfo.size() << "\n";
+        snapshot << "flow_table.classifier=" << CLASSIFYMODENAME[classifierMode] << "\n";
+        snapshot << "pending_queries=" << sentQueries.numSent << "\n";
+        appendHistogram(snapshot, "query_latency", queryLatency);
     }
     else
     {
-        cout << "Received signal: " << signo << ". Unable to handle this signal." << endl;
+        snapshot << "switches.connected=" << connectionInfo.size() << "\n";
+        snapshot << "coalesce.window_msec=" << queryCoalesceMsec << "\n";
+        snapshot << "coalesce.queries=" << coalesceStats["queries"] << "\n";
+        snapshot << "coalesce.routes=" << coalesceStats["routes"] << "\n";
+        snapshot << "coalesce.batches=" << coalesceStats["batches"] << "\n";
+        snapshot << "pending_queries=" << pendingQueries.size() << "\n";
+        appendHistogram(snapshot, "query_wait", queryWaitLatency);
     }
+
+    snapshot << "pool.in_use=" << queuePool.inUse << "\n";
+    snapshot << "pool.size=" << PACKET_POOL_SIZE << "\n";
+    snapshot << "pool.high_water=" << queuePool.highWater << "\n";
+    snapshot << "pool.exhausted=" << queuePool.exhausted << "\n";
+    return snapshot.str();
+}
+
+// answers the clients waiting on the metrics socket, the snapshot is only built when one is waiting
+void pollMetricsSocket()
+{
+    if (metricsFileDescriptor < 0)
+    {
+        return;
+    }
+    struct pollfd metrics[1];
+    metrics[0].fd = metricsFileDescriptor;
+    metrics[0].events = POLLIN;
+    if (poll(metrics, 1, 0) > 0)
+    {
+        serveMetricsClients(metricsFileDescriptor, buildMetricsSnapshot());
+    }
+}
+
+// removes the metrics socket file when the program exits
+void removeMetricsSocket()
+{
+    if (metricsFileDescriptor >= 0)
+    {
+        close(metricsFileDescriptor);
+        unlink(metricsPath.c_str());
+    }
+}
+
+// routes SIGUSR1 to a signalfd and opens the metrics socket for the controller or a switch
+// returns false if the signals could not be set up, the metrics socket is optional
+bool openEventSources(string name)
+{
+    processName = name;
+    initLatencyHistogram(queryLatency);
+    initLatencyHistogram(queryWaitLatency);
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGUSR1);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0)
+    {
+        cout << "Problem blocking USER1" << endl;
+        return false;
+    }
+    if ((signalFileDescriptor = signalfd(-1, &mask, SFD_NONBLOCK)) < 0)
+    {
+        cout << "Problem setting signalfd for USER1" << endl;
+        return false;
+    }
+
+    metricsPath = metricsSocketPath(name);
+    if ((metricsFileDescriptor = openMetricsSocket(metricsPath)) < 0)
+    {
+        cout << "Continuing without a metrics socket." << endl;
+    }
+    else
+    {
+        atexit(removeMetricsSocket);
+    }
+    return true;
 }
 
 // initialize the packet stats for the controller
@@ -159,6 +362,23 @@ void initializeSwitchPacketStats()
     pktStats.transmitted.insert(pair<packetType, int>(OPEN, 0));
     pktStats.transmitted.insert(pair<packetType, int>(QUERY, 0));
     pktStats.transmitted.insert(pair<packetType, int>(RELAYOUT, 0));
+
+    if (switchQueuePolicy == BACKPRESSURE)
+    {
+        pktStats.received.insert(pair<packetType, int>(PAUSE, 0));
+        pktStats.received.insert(pair<packetType, int>(RESUME, 0));
+        pktStats.transmitted.insert(pair<packetType, int>(PAUSE, 0));
+        pktStats.transmitted.insert(pair<packetType, int>(RESUME, 0));
+    }
+
+    pktStats.dropped.insert(pair<dropReason, int>(QUEUEFULL, 0));
+    pktStats.dropped.insert(pair<dropReason, int>(DESTFULL, 0));
+    pktStats.dropped.insert(pair<dropReason, int>(LINKFULL, 0));
+
+    for (int port = 1; port <= 3; ++port)
+    {
+        pktStats.portTransmitted.insert(pair<int, int>(port, 0));
+    }
 }
 
 // close the open fifos and exit the program
@@ -410,6 +630,11 @@ void verifyNetwork()
 // creates a fifo name for a sender to send to a receiver
 string determineFIFOName(int sender, int receiver)
 {
+    // names are built once and reused on every write
+    if (!fifoNames[sender][receiver].empty())
+    {
+        return fifoNames[sender][receiver];
+    }
     stringstream ss;
     ss << sender;
     string fifo = "fifo--";
@@ -422,20 +647,163 @@ string determineFIFOName(int sender, int receiver)
     // insert to make "fifo-s-r"
     fifo.insert(7, ss.str());
 
+    fifoNames[sender][receiver] = fifo;
     return fifo;
 }
 
+// writes a packet to a neighbouring switch's fifo without blocking
+writeResult writePacketToFIFO(int sender, int receiver, packet outPacket)
+{
+    int fd;
+    string fifo = determineFIFOName(sender, receiver);
+
+    // open the corresponding fifo, ENXIO means the neighbour has not opened it for reading yet
+    if ((fd = open(fifo.c_str(), O_WRONLY | O_NONBLOCK)) < 0)
+    {
+        if (errno == ENXIO)
+        {
+            return WRITE_BLOCKED;
+        }
+        cout << "Unable to open fifo " << fifo << " for write." << endl;
+        return WRITE_FAILED;
+    }
+
+    // write the packet, a single packet is smaller than PIPE_BUF so it is written whole or not at all
+    if (write(fd, (char *) &outPacket, sizeof(outPacket)) < 0)
+    {
+        close(fd);
+        if (errno == EAGAIN)
+        {
+            return WRITE_BLOCKED;
+        }
+        cout << "Unable to write packet to " << fifo << endl;
+        return WRITE_FAILED;
+    }
+    close(fd);
+    return WRITE_OK;
+}
+
+// switch sends the packets held in its link queues until a fifo is full again
+void flushLinkQueues(int currSwitchNumber)
+{
+    for (int receiver = 1; receiver <= MAX_NSW; ++receiver)
+    {
+        packetList &linkQueue = linkQueues[receiver];
+        while (linkQueue.head != NIL)
+        {
+            packet &outPacket = queuePool.slots[linkQueue.head].pkt;
+            bool control = (outPacket.type == PAUSE || outPacket.type == RESUME);
+            if (!control && pausedLinks[receiver])
+            {
+                break;
+            }
+            writeResult result = writePacketToFIFO(currSwitchNumber, receiver, outPacket);
+            if (result == WRITE_BLOCKED)
+            {
+                break;
+            }
+            if (result == WRITE_OK)
+            {
+                printPacketMessage(currSwitchNumber, receiver, outPacket, true);
+                countRelayWritten(receiver, outPacket);
+            }
+            freeSlot(queuePool, popFrontSlot(queuePool, linkQueue));
+        }
+    }
+}
+
+// returns the number of packets a switch is holding in its queues
+int queuedPacketCount()
+{
+    int count = packetQueue.size;
+    for (int receiver = 1; receiver <= MAX_NSW; ++receiver)
+    {
+        count += linkQueues[receiver].size;
+    }
+    return count;
+}
+
+// returns the number of queued packets that can drain while the switch has paused its neighbours
+// packets held for a neighbour that has paused this switch are left out, otherwise two congested
+// neighbours that pause each other would never drain below the low watermark
+int congestedPacketCount()
+{
+    int count = packetQueue.size;
+    for (int receiver = 1; receiver <= MAX_NSW; ++receiver)
+    {
+        if (!pausedLinks[receiver])
+        {
+            count += linkQueues[receiver].size;
+        }
+    }
+    return count;
+}
+
+// switch asks its neighbours to pause when its queues pass the high watermark
+// and to resume once they drain below the low watermark
+void checkBackpressure(int currSwitchNumber)
+{
+    if (switchQueuePolicy != BACKPRESSURE)
+    {
+        return;
+    }
+    int count = congestedPacketCount();
+    packet outPacket;
+    if (!upstreamPaused && count >= BACKPRESSURE_HIGH)
+    {
+        upstreamPaused = true;
+        outPacket.type = PAUSE;
+        cout << endl << "** Queues are congested (" << count << " packets). Pausing upstream switches." << endl;
+    }
+    else if (upstreamPaused && count <= BACKPRESSURE_LOW)
+    {
+        upstreamPaused = false;
+        outPacket.type = RESUME;
+        cout << endl << "** Queues have drained (" << count << " packets). Resuming upstream switches." << endl;
+    }
+    else
+    {
+        return;
+    }
+    for (int port = 1; port <= 2; ++port)
+    {
+        if (neighbourSwitches[port] > 0)
+        {
+            sendPacket(currSwitchNumber, neighbourSwitches[port], outPacket);
+            pktStats.transmitted[outPacket.type] += 1;
+        }
+    }
+}
+
+// writes every byte of buf to a socket, a blocking socket can still take only part of a write
+// when it is interrupted, returns false if the socket failed
+bool writeSocket(int fd, const char *buf, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t numBytes = write(fd, buf, length);
+        if (numBytes < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (numBytes < 0)
+        {
+            return false;
+        }
+        buf += numBytes;
+        length -= numBytes;
+    }
+    return true;
+}
+
 // sends a packet to a receiver
 bool sendPacket(int sender, int receiver, packet outPacket)
 {
-    int fd;
-    ssize_t numBytes;
     if (sender == 0 || receiver == 0)
     {
         // controller sending to switch or switch sending to controller
         // use the socket descripors
-        fd = socketFileDescriptors[receiver];
-        if ((numBytes = write(fd, (char *) &outPacket, sizeof(outPacket))) < 0)
+        if (!writeSocket(socketFileDescriptors[receiver], (char *) &outPacket, sizeof(outPacket)))
         {
             cout << "Unable to write packet on socket to " << receiver << endl;
             return false;
@@ -444,37 +812,164 @@ bool sendPacket(int sender, int receiver, packet outPacket)
     else 
     {
         // switch sending to switch
-        string fifo = determineFIFOName(sender, receiver);
-
-        // open the corresponding fifo
-        if ((fd = open(fifo.c_str(), O_WRONLY)) < 0)
+        // packets wait in the link queue while the neighbour is paused or its fifo is full,
+        // PAUSE and RESUME are never held back by a pause
+        bool control = (outPacket.type == PAUSE || outPacket.type == RESUME);
+        if (!control && (pausedLinks[receiver] || linkQueues[receiver].head != NIL))
         {
-            cout << "Unable to open fifo " << fifo << " for write." << endl;
-            return false;
+            return enqueueLinkPacket(queuePool, linkQueues[receiver], receiver, outPacket, switchQueuePolicy, pktStats.dropped);
         }
-
-        // write the packet
-        if ((numBytes = write(fd, (char *) &outPacket, sizeof(outPacket))) < 0)
+        writeResult result = writePacketToFIFO(sender, receiver, outPacket);
+        if (result == WRITE_BLOCKED)
+        {
+            if (control)
+            {
+                // control packets jump the queue, fall back to dropping if the pool is exhausted
+                return pushFrontPacket(queuePool, linkQueues[receiver], outPacket);
+            }
+            return enqueueLinkPacket(queuePool, linkQueues[receiver], receiver, outPacket, switchQueuePolicy, pktStats.dropped);
+        }
+        if (result == WRITE_FAILED)
         {
-            cout << "Unable to write packet to " << fifo << endl;
             return false;
         }
-        
-        close(fd);
     }
     // print the transmitted message
     printPacketMessage(sender, receiver, outPacket, true);
+    if (sender != 0 && receiver != 0)
+    {
+        countRelayWritten(receiver, outPacket);
+    }
     return true;
 }
 
+// switch counts a RELAY packet once it is written to a neighbour's fifo, a packet that is held
+// in a link queue is counted when it is flushed and one that is dropped is not counted
+void countRelayWritten(int receiver, packet outPacket)
+{
+    if (outPacket.type != RELAY)
+    {
+        return;
+    }
+    pktStats.transmitted[RELAYOUT] += 1;
+    for (int port = 1; port <= 2; ++port)
+    {
+        if (neighbourSwitches[port] == receiver)
+        {
+            pktStats.portTransmitted[port] += 1;
+            break;
+        }
+    }
+}
+
+// controller sends a batch of packets to a switch, writing until the whole batch is on its socket
+bool sendPacketBatch(int receiver, vector<packet> &outPackets)
+{
+    if (!writeSocket(socketFileDescriptors[receiver], (char *) &outPackets[0], outPackets.size() * sizeof(packet)))
+    {
+        cout << "Unable to write packet batch on socket to " << receiver << endl;
+        return false;
+    }
+    for (int i = 0; i < outPackets.size(); ++i)
+    {
+        printPacketMessage(0, receiver, outPackets[i], true);
+    }
+    return true;
+}
+
+// controller looks up a switch in the switch table, returns false if it has not connected
+bool findSwitch(int switchNumber, openMessage &sw)
+{
+    for (vector<message>::iterator it = connectionInfo.begin(); it != connectionInfo.end(); ++it)
+    {
+        if (it->oMessage.switchNumber == switchNumber)
+        {
+            sw = it->oMessage;
+            return true;
+        }
+    }
+    return false;
+}
+
+// controller computes the number of hops from every switch to the destination switch
+// breadth first search outward from the destination over the port1/port2 links
+map<int, int> computeHops(int destSwitchNumber)
+{
+    map<int, int> hops;
+    queue<int> frontier;
+    hops[destSwitchNumber] = 0;
+    frontier.push(destSwitchNumber);
+    while (!frontier.empty())
+    {
+        int current = frontier.front();
+        frontier.pop();
+
+        openMessage sw;
+        if (!findSwitch(current, sw))
+        {
+            continue;
+        }
+        int neighbours[2] = {sw.port1Switch, sw.port2Switch};
+        for (int i = 0; i < 2; ++i)
+        {
+            if (neighbours[i] > 0 && hops.count(neighbours[i]) == 0)
+            {
+                hops[neighbours[i]] = hops[current] + 1;
+                frontier.push(neighbours[i]);
+            }
+        }
+    }
+    return hops;
+}
+
+// controller determines which ports of a switch lie on a shortest path to the destination switch
+// hops holds the hop counts to the destination computed by computeHops()
+// returns the equal-cost ports as a bitmask (bit p set for port p), 0 if the destination is unreachable
+int findEqualCostPorts(int switchNumber, map<int, int> &hops)
+{
+    openMessage self;
+    if (!findSwitch(switchNumber, self) || hops.count(switchNumber) == 0)
+    {
+        return 0;
+    }
+
+    // every neighbour one hop closer to the destination is an equal-cost next hop
+    int portMask = 0;
+    int ports[3] = {0, self.port1Switch, self.port2Switch};
+    for (int port = 1; port <= 2; ++port)
+    {
+        if (ports[port] > 0 && hops.count(ports[port]) > 0 && hops[ports[port]] == hops[switchNumber] - 1)
+        {
+            portMask |= (1 << port);
+        }
+    }
+    return portMask;
+}
+
+// controller finds the switch whose IP range holds destIP
+bool findDestSwitch(int destIP, openMessage &dest)
+{
+    for (vector<message>::iterator it = connectionInfo.begin(); it != connectionInfo.end(); ++it)
+    {
+        if (destIP >= it->oMessage.ipLow && destIP <= it->oMessage.ipHigh)
+        {
+            dest = it->oMessage;
+            return true;
+        }
+    }
+    return false;
+}
+
 // controller processes a query packet in the network and returns a corresponding ADD packet
 // to be sent to a switch as a new rule
-packet processQueryPacket(queryRelayMessage qrMessage, int switchNumber)
+// destHops may hold the hop counts to the destination switch if they were already computed for a batch of queries
+packet processQueryPacket(queryRelayMessage qrMessage, int switchNumber, map<int, int> *destHops = NULL)
 {
     // ip addresses are disjoint
     int ipLow;
     int ipHigh;
     int forwardPort;
+    int destSwitchNumber;
     bool destBeforeSwitch;
     bool foundDest = false;
     int srcIP = qrMessage.srcIP;
@@ -498,6 +993,7 @@ packet processQueryPacket(queryRelayMessage qrMessage, int switchNumber)
             // the destination IP is in the range, this is the switch to send to
             destBeforeSwitch = false; 
             foundDest = true;
+            destSwitchNumber = it->oMessage.switchNumber;
             ipLow = it->oMessage.ipLow; 
             ipHigh = it->oMessage.ipHigh;          
         }
@@ -513,6 +1009,18 @@ packet processQueryPacket(queryRelayMessage qrMessage, int switchNumber)
 
     if (foundDest)
     {
+        // spread the traffic across every port on a shortest path if there is more than one
+        map<int, int> hops;
+        if (destHops == NULL)
+        {
+            hops = computeHops(destSwitchNumber);
+            destHops = &hops;
+        }
+        int portMask = findEqualCostPorts(switchNumber, *destHops);
+        if (__builtin_popcount(portMask) > 1)
+        {
+            return createAMessagePacket(ADD, 0, MAXIP, ipLow, ipHigh, ECMP, portMask, MINPRI, 0);
+        }
         // destination switch was found so forward the packet in that direction
         return createAMessagePacket(ADD, 0, MAXIP, ipLow, ipHigh, FORWARD, forwardPort, MINPRI, 0);
     }
@@ -520,32 +1028,146 @@ packet processQueryPacket(queryRelayMessage qrMessage, int switchNumber)
     return createAMessagePacket(ADD, 0, MAXIP, destIP, destIP, DROP, 0, MINPRI, 0);
 }
 
-// switches search their respective flow table for a valid rule and set the outPort value
-bool processRelayPacket(queryRelayMessage qrMessage, int &outPort)
+// returns true if two ADD packets hold the same rule
+bool sameRule(packet a, packet b)
 {
-    int foundIndex = -1;
-    for (int i = 0; i < connectionInfo.size(); ++i)
+    return a.msg.aMessage.srcIPLo == b.msg.aMessage.srcIPLo &&
+           a.msg.aMessage.srcIPHi == b.msg.aMessage.srcIPHi &&
+           a.msg.aMessage.destIPLo == b.msg.aMessage.destIPLo &&
+           a.msg.aMessage.destIPHi == b.msg.aMessage.destIPHi &&
+           a.msg.aMessage.actionType == b.msg.aMessage.actionType &&
+           a.msg.aMessage.actionVal == b.msg.aMessage.actionVal &&
+           a.msg.aMessage.pri == b.msg.aMessage.pri;
+}
+
+// controller answers every query that arrived during the coalescing window
+// queries are grouped by destination switch so each route is only computed once,
+// then every switch is sent its new rules in a single write
+void flushPendingQueries()
+{
+    if (pendingQueries.empty())
+    {
+        return;
+    }
+    cout << endl << "Coalescing window closed. Answering " << pendingQueries.size() << " queries..." << endl;
+
+    // group the queries by destination, -1 holds the ones with no destination switch
+    map<int, vector<int> > byDestination;
+    for (int i = 0; i < pendingQueries.size(); ++i)
     {
-        int pri = MINPRI; 
-        int srcIPLo = connectionInfo[i].aMessage.srcIPLo;
-        int srcIPHi = connectionInfo[i].aMessage.srcIPHi;
-        int destIPLo = connectionInfo[i].aMessage.destIPLo;
-        int destIPHi = connectionInfo[i].aMessage.destIPHi;
-        if (qrMessage.srcIP >= srcIPLo && qrMessage.srcIP <= srcIPHi && qrMessage.destIP >= destIPLo && qrMessage.destIP <= destIPHi)
+        openMessage dest;
+        int destSwitchNumber = -1;
+        if (findDestSwitch(pendingQueries[i].msg.qrMessage.destIP, dest))
+        {
+            destSwitchNumber = dest.switchNumber;
+        }
+        byDestination[destSwitchNumber].push_back(i);
+    }
+
+    // compute the route to each destination once and build the new rules for each switch
+    map<int, vector<packet> > batches;
+    for (map<int, vector<int> >::iterator it = byDestination.begin(); it != byDestination.end(); ++it)
+    {
+        map<int, int> hops;
+        if (it->first != -1)
+        {
+            hops = computeHops(it->first);
+            coalesceStats["routes"] += 1;
+        }
+        for (int i = 0; i < it->second.size(); ++i)
         {
-            // found a matching rule, use the last one in the case of matching priority 
-            if (connectionInfo[i].aMessage.pri >= pri)
+            packet query = pendingQueries[it->second[i]];
+            int switchNumber = query.msg.qrMessage.sendingSwitchNumber;
+            packet outPacket = processQueryPacket(query.msg.qrMessage, switchNumber, &hops);
+
+            // several queries from one switch for the same destination only need one rule
+            bool duplicate = false;
+            for (int j = 0; j < batches[switchNumber].size(); ++j)
+            {
+                if (sameRule(batches[switchNumber][j], outPacket))
+                {
+                    duplicate = true;
+                    break;
+                }
+            }
+            if (!duplicate)
             {
-                pri = connectionInfo[i].aMessage.pri;
-                foundIndex = i;
+                batches[switchNumber].push_back(outPacket);
             }
         }
     }
+
+    // send each switch its batch of rules
+    for (map<int, vector<packet> >::iterator it = batches.begin(); it != batches.end(); ++it)
+    {
+        if (sendPacketBatch(it->first, it->second))
+        {
+            pktStats.transmitted[ADD] += it->second.size();
+            coalesceStats["batches"] += 1;
+        }
+    }
+    coalesceStats["queries"] += pendingQueries.size();
+    for (int i = 0; i < pendingQueryTimes.size(); ++i)
+    {
+        recordLatency(queryWaitLatency, elapsedMicroseconds(pendingQueryTimes[i]));
+    }
+    pendingQueries.clear();
+    pendingQueryTimes.clear();
+}
+
+// controller holds a query until the coalescing window closes
+void addPendingQuery(packet inPacket, int sendingSwitchNumber)
+{
+    if (pendingQueries.empty())
+    {
+        // the window opens with the first query
+        gettimeofday(&coalesceStartTime, NULL);
+    }
+    inPacket.msg.qrMessage.sendingSwitchNumber = sendingSwitchNumber;
+    pendingQueries.push_back(inPacket);
+    struct timeval arrival;
+    gettimeofday(&arrival, NULL);
+    pendingQueryTimes.push_back(arrival);
+}
+
+// controller checks if the coalescing window has closed and answers the pending queries if so
+void checkPendingQueries()
+{
+    if (pendingQueries.empty())
+    {
+        return;
+    }
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    long long elapsed = ((now.tv_sec * 1000000 + now.tv_usec) - (coalesceStartTime.tv_sec * 1000000 + coalesceStartTime.tv_usec)) / 1000;
+    if (elapsed >= queryCoalesceMsec)
+    {
+        flushPendingQueries();
+    }
+}
+
+// switches search their respective flow table for a valid rule and set the outPort value
+// foundIndex may be passed in if the packet was already classified as part of a batch
+// the best rule has the lowest pri value, the last one added is used in the case of matching priority
+bool processRelayPacket(queryRelayMessage qrMessage, int &outPort, int foundIndex = UNCLASSIFIED)
+{
+    if (foundIndex == UNCLASSIFIED)
+    {
+        foundIndex = classifyPacket(flowTable, qrMessage.srcIP, qrMessage.destIP, classifierMode);
+    }
     if (foundIndex > -1) 
     {
         // we found a rule in the flow table
         connectionInfo[foundIndex].aMessage.pktCount += 1;
-        outPort = connectionInfo[foundIndex].aMessage.actionVal;
+        if (connectionInfo[foundIndex].aMessage.actionType == ECMP)
+        {
+            // hash the flow onto one of the equal-cost ports
+            outPort = ecmpSelectPort(connectionInfo[foundIndex].aMessage.actionVal, qrMessage.srcIP, qrMessage.destIP);
+        }
+        else
+        {
+            outPort = connectionInfo[foundIndex].aMessage.actionVal;
+        }
         return true;
     }
     outPort = 0;
@@ -572,8 +1194,38 @@ bool ruleExists(message msg)
     return false;
 }
 
+// switch sends a packet out of the port chosen by its flow table rule
+// port 0 drops the packet, ports 1 and 2 relay it to the neighbouring switches, port 3 delivers it to the network
+bool forwardPacket(packet inPacket, int outPort, int currSwitchNumber, int port1Switch, int port2Switch)
+{
+    bool status = true;
+    if (outPort == 1)
+    {
+        // RELAYOUT and the port counter are updated once the packet is written, see countRelayWritten
+        inPacket.type = RELAY;
+        status = sendPacket(currSwitchNumber, port1Switch, inPacket);
+    }
+    else if (outPort == 2)
+    {
+        inPacket.type = RELAY;
+        status = sendPacket(currSwitchNumber, port2Switch, inPacket);
+    }
+    else if (outPort == 3) 
+    {
+        // transmit the packet to the network
+        printPacketMessage(currSwitchNumber, NETPORT, inPacket, true);
+        pktStats.portTransmitted[outPort] += 1;
+    }
+    else if (outPort == 0) 
+    {
+        cout << "Packet dropped." << endl;
+    }
+    return status;
+}
+
 // the main function for processing all types of packets for both the controller and switches
-bool processPacket(packet inPacket, int currSwitchNumber, int port1Switch = -2, int port2Switch = -2, int sendingSwitchNumber = -2, int numSwitches = 0)
+// ruleIndex is the result of batch classification for RELAY packets, UNCLASSIFIED otherwise
+bool processPacket(packet inPacket, int currSwitchNumber, int port1Switch = -2, int port2Switch = -2, int sendingSwitchNumber = -2, int numSwitches = 0, int ruleIndex = UNCLASSIFIED)
 {   
     cout << endl;
     packet outPacket;
@@ -618,7 +1270,7 @@ bool processPacket(packet inPacket, int currSwitchNumber, int port1Switch = -2,
                     // all switches have connected, we can process all queries that have come in
                     verifyNetwork();
                     cout << "All switches have connected. Processing query queue..." << endl;
-                    processPacketQueue(currSwitchNumber, -1, -1);
+                    processQueryQueue(currSwitchNumber);
                 }
             }
             else
@@ -634,12 +1286,19 @@ bool processPacket(packet inPacket, int currSwitchNumber, int port1Switch = -2,
                 inPacket.type = QUEUEDQUERY;
                 // set the sending switch number for later
                 inPacket.msg.qrMessage.sendingSwitchNumber = sendingSwitchNumber;
-                packetQueue.push(inPacket);
+                // the queue is not bounded by the packet pool, a dropped query would never be asked again
+                queuedQueries.push_back(inPacket);
                 cout << "Waiting for additional switches to connect. Packet was added to the queue." << endl;
-                cout << "Number of packets in queue: " << packetQueue.size() << endl;
+                cout << "Number of packets in queue: " << queuedQueries.size() << endl;
                 return true;
             }
             // all switches have connected
+            if (queryCoalesceMsec > 0)
+            {
+                // answer the query together with the others that arrive during the coalescing window
+                addPendingQuery(inPacket, sendingSwitchNumber);
+                return true;
+            }
             // process the query, send back the new rule
             outPacket = processQueryPacket(msg.qrMessage, sendingSwitchNumber);
             status = sendPacket(currSwitchNumber, sendingSwitchNumber, outPacket);
@@ -649,6 +1308,13 @@ bool processPacket(packet inPacket, int currSwitchNumber, int port1Switch = -2,
             // all switches have connected so send the new rules from the queue
             cout << "Processing packet: ";
             printMessage(msg.qrMessage);
+            if (queryCoalesceMsec > 0)
+            {
+                cout << "Waiting for the coalescing window." << endl;
+                inPacket.type = QUERY;
+                addPendingQuery(inPacket, sendingSwitchNumber);
+                return true;
+            }
             cout << "Sending new rule." << endl;
             outPacket = processQueryPacket(msg.qrMessage, sendingSwitchNumber);
             status = sendPacket(currSwitchNumber, sendingSwitchNumber, outPacket);
@@ -672,6 +1338,9 @@ bool processPacket(packet inPacket, int currSwitchNumber, int port1Switch = -2,
                 // add the packet message to connection info as a new rule
                 cout << "New rule added to flow table. Processing queue with new rule..." << endl;
                 connectionInfo.push_back(msg);
+                appendFlowTableSoA(flowTable, msg.aMessage);
+                classifierMode = selectClassifyMode(flowTable);
+                recordAnsweredQueries(sentQueries, msg.aMessage, queryLatency);
 
                 // process the waiting RELAY and ADMIT packet queue
                 processPacketQueue(currSwitchNumber, port1Switch, port2Switch);
@@ -681,25 +1350,19 @@ bool processPacket(packet inPacket, int currSwitchNumber, int port1Switch = -2,
         case RELAY:
             pktStats.received[RELAYIN] += 1;
             // process the packet and set the value of outPort based on the rule
-            if (!processRelayPacket(msg.qrMessage, outPort)) 
+            if (!processRelayPacket(msg.qrMessage, outPort, ruleIndex)) 
             {
                 // rule was not found
                 cout << "No rule found. Adding to queue." << endl;
                 // change packet type and add to queue
                 inPacket.type = QUEUEDRELAY;
-                packetQueue.push(inPacket);
-                cout << "Number of packets in queue: " << packetQueue.size() << endl;
+                enqueueWaitingPacket(queuePool, packetQueue, inPacket, switchQueuePolicy, pktStats.dropped);
+                cout << "Number of packets in queue: " << packetQueue.size << endl;
                 
                 // send query packet to controller if necessary
-                bool ltsrcIP;
-                if (msg.qrMessage.srcIP > MAXIP) 
-                    ltsrcIP = false;
-                else
-                    ltsrcIP = true;
-                if ((pendingQuerySet.count(pair<bool, int>(ltsrcIP, msg.qrMessage.destIP))) == 0)
+                if (markQuerySent(sentQueries, msg.qrMessage))
                 {
                     // there are not matching pending queries so send one
-                    pendingQuerySet.insert(pair<bool, int>(ltsrcIP, msg.qrMessage.destIP));
                     inPacket.type = QUERY;
                     status = sendPacket(currSwitchNumber, 0, inPacket);
                     pktStats.transmitted[QUERY] += 1;
@@ -710,27 +1373,7 @@ bool processPacket(packet inPacket, int currSwitchNumber, int port1Switch = -2,
                 return true;
             }
             // rule was found so follow the rule on packet
-            if (outPort == 1)
-            {
-                inPacket.type = RELAY;
-                status = sendPacket(currSwitchNumber, port1Switch, inPacket);
-                pktStats.transmitted[RELAYOUT] += 1;
-            }
-            else if (outPort == 2)
-            {
-                inPacket.type = RELAY;
-                status = sendPacket(currSwitchNumber, port2Switch, inPacket);
-                pktStats.transmitted[RELAYOUT] += 1;
-            }
-            else if (outPort == 3) 
-            {
-                // transmit the packet to the network
-                printPacketMessage(currSwitchNumber, NETPORT, inPacket, true);
-            }
-            else if (outPort == 0) 
-            {
-                cout << "Packet dropped." << endl;
-            }
+            status = forwardPacket(inPacket, outPort, currSwitchNumber, port1Switch, port2Switch);
             break;
         case ADMIT:
             pktStats.received[ADMIT] += 1;
@@ -741,19 +1384,13 @@ bool processPacket(packet inPacket, int currSwitchNumber, int port1Switch = -2,
                 cout << "No rule found. Adding to queue." << endl;
                 // change type and add to queue
                 inPacket.type = QUEUEDRELAY;
-                packetQueue.push(inPacket);
-                cout << "Number of packets in queue: " << packetQueue.size() << endl;
+                enqueueWaitingPacket(queuePool, packetQueue, inPacket, switchQueuePolicy, pktStats.dropped);
+                cout << "Number of packets in queue: " << packetQueue.size << endl;
 
                 // send query packet to controller if necessary
-                bool ltsrcIP;
-                if (msg.qrMessage.srcIP > MAXIP) 
-                    ltsrcIP = false;
-                else
-                    ltsrcIP = true;
-                if ((pendingQuerySet.count(pair<bool, int>(ltsrcIP, msg.qrMessage.destIP))) == 0)
+                if (markQuerySent(sentQueries, msg.qrMessage))
                 {
                     // there are not matching pending queries so send one
-                    pendingQuerySet.insert(pair<bool, int>(ltsrcIP, msg.qrMessage.destIP));
                     inPacket.type = QUERY;
                     status = sendPacket(currSwitchNumber, 0, inPacket);
                     pktStats.transmitted[QUERY] += 1;
@@ -764,27 +1401,7 @@ bool processPacket(packet inPacket, int currSwitchNumber, int port1Switch = -2,
                 return true;
             }
             // rule was found so follow the rule on packet
-            if (outPort == 1)
-            {
-                inPacket.type = RELAY;
-                status = sendPacket(currSwitchNumber, port1Switch, inPacket);
-                pktStats.transmitted[RELAYOUT] += 1;
-            }
-            else if (outPort == 2)
-            {
-                inPacket.type = RELAY;
-                status = sendPacket(currSwitchNumber, port2Switch, inPacket);
-                pktStats.transmitted[RELAYOUT] += 1;
-            }
-            else if (outPort == 3) 
-            {
-                // transmit the packet to the network
-                printPacketMessage(currSwitchNumber, NETPORT, inPacket, true);
-            }
-            else if (outPort == 0) 
-            {
-                cout << "Packet dropped." << endl;
-            }
+            status = forwardPacket(inPacket, outPort, currSwitchNumber, port1Switch, port2Switch);
             break;
         case QUEUEDRELAY:
             cout << "Processing packet: ";
@@ -793,41 +1410,26 @@ bool processPacket(packet inPacket, int currSwitchNumber, int port1Switch = -2,
             {
                 // rule was not found
                 cout << "No rule found. Packet returned to queue." << endl;
-                // put the packet back on the queue
-                packetQueue.push(inPacket);
+                // put the packet back on the queue, the slot it was popped from is still free
+                pushBackPacket(queuePool, packetQueue, inPacket);
                 return false;
             }
             // rule was found so follow the rule on packet
             cout << "Rule found. Delivering packet." << endl;
-            // remove from the pending query set
-            bool ltsrcIP;
-            if (msg.qrMessage.srcIP > MAXIP) 
-                ltsrcIP = false;
-            else
-                ltsrcIP = true;
-            pendingQuerySet.erase(pair<bool, int>(ltsrcIP, msg.qrMessage.destIP));
+            // the next packet to miss sends a new query
+            clearQuerySent(sentQueries, msg.qrMessage);
             // deliver the packet
-            if (outPort == 1)
-            {
-                inPacket.type = RELAY;
-                status = sendPacket(currSwitchNumber, port1Switch, inPacket);
-                pktStats.transmitted[RELAYOUT] += 1;
-            }
-            else if (outPort == 2)
-            {
-                inPacket.type = RELAY;
-                status = sendPacket(currSwitchNumber, port2Switch, inPacket);
-                pktStats.transmitted[RELAYOUT] += 1;
-            }
-            else if (outPort == 3) 
-            {
-                // transmit the packet to the network
-                printPacketMessage(currSwitchNumber, NETPORT, inPacket, true);
-            }
-            else if (outPort == 0) 
-            {
-                cout << "Packet dropped." << endl;
-            }
+            status = forwardPacket(inPacket, outPort, currSwitchNumber, port1Switch, port2Switch);
+            break;
+        case PAUSE:
+            // the neighbour is congested, hold packets for it in the link queue
+            pktStats.received[PAUSE] += 1;
+            pausedLinks[sendingSwitchNumber] = true;
+            break;
+        case RESUME:
+            pktStats.received[RESUME] += 1;
+            pausedLinks[sendingSwitchNumber] = false;
+            flushLinkQueues(currSwitchNumber);
             break;
         case EXIT:
             // kill the switch
@@ -873,18 +1475,36 @@ void removeSwitch(int numConnectedSwitches, struct pollfd contSockets[], int soc
 // they will be added back if not successful
 void processPacketQueue(int currSwitchNumber, int port1Switch, int port2Switch)
 {
-    int count = packetQueue.size();
+    int count = packetQueue.size;
     if (count == 0)
     {
         cout << "Query queue is empty." << endl;
     }
     for (int i = 0; i < count; ++i)
     {
-        packet inPacket = packetQueue.front();
-        packetQueue.pop();
+        // free the slot before processing so a packet that is returned to the queue reuses it
+        int slot = popFrontSlot(queuePool, packetQueue);
+        packet inPacket = queuePool.slots[slot].pkt;
+        freeSlot(queuePool, slot);
         processPacket(inPacket, currSwitchNumber, port1Switch, port2Switch, inPacket.msg.qrMessage.sendingSwitchNumber);    
     }
-    cout << endl << "Finished processing queue. Number of packets still in queue: " << packetQueue.size() << endl;
+    cout << endl << "Finished processing queue. Number of packets still in queue: " << packetQueue.size << endl;
+}
+
+// controller answers the queries that arrived before every switch connected
+void processQueryQueue(int currSwitchNumber)
+{
+    if (queuedQueries.empty())
+    {
+        cout << "Query queue is empty." << endl;
+    }
+    vector<packet> queries;
+    queries.swap(queuedQueries);
+    for (int i = 0; i < queries.size(); ++i)
+    {
+        processPacket(queries[i], currSwitchNumber, -1, -1, queries[i].msg.qrMessage.sendingSwitchNumber);
+    }
+    cout << endl << "Finished processing queue. Number of packets still in queue: " << queuedQueries.size() << endl;
 }
 
 // Checks the name of a switch and returns the switch number if valid
@@ -918,20 +1538,20 @@ bool checkSwitchName(string name, int &switchNumber)
 }
 
 // the main loop for the controller
-void controllerMainLoop(int numSwitches, int portNumber) 
+void controllerMainLoop(int numSwitches, int portNumber, int coalesceMsec) 
 {   
     // initialize controller global variables
     isSwitch = false;
+    queryCoalesceMsec = coalesceMsec;
     connectionInfo.clear();
     initializeControllerPacketStats();
     int socketSwitchNumbers[numSwitches];
    
-    // set up signal handler for USER1
-    if (signal(SIGUSR1, user1SignalHandler) == SIG_ERR)
+    // receive USER1 through a signalfd and serve metrics on a unix socket
+    if (!openEventSources("cont"))
     {
-        cout << "Problem setting signal handler for USER1" << endl;
         return;
-    } 
+    }
 
     // open manager socket
     struct pollfd contManagerSocket[1];
@@ -1003,8 +1623,13 @@ void controllerMainLoop(int numSwitches, int portNumber)
             }
         }
 
-        // poll the user input
+        // poll the user input, signals and metrics clients
         pollUserInput(contSockets, numConnectedSwitches);       
+        pollSignals();
+        pollMetricsSocket();
+
+        // answer the coalesced queries once their window closes
+        checkPendingQueries();
 
         //poll all the sockets for packets
         if (poll(contSockets, numConnectedSwitches, 0) > 0)
@@ -1057,10 +1682,13 @@ void controllerMainLoop(int numSwitches, int portNumber)
     } // end while(true)
 }
 
-void switchMainLoop(flowTableEntry firstEntry, int switchNumber, string trafficFile, int port1Switch, int port2Switch, char *serverAddress, int portNumber) 
+void switchMainLoop(flowTableEntry firstEntry, int switchNumber, string trafficFile, int port1Switch, int port2Switch, char *serverAddress, int portNumber, queuePolicy policy) 
 {   
     // initialize the switch
     isSwitch = true;
+    switchQueuePolicy = policy;
+    neighbourSwitches[1] = port1Switch;
+    neighbourSwitches[2] = port2Switch;
     int numInFIFOS = 3;
     bool finished = false;
     bool delayed = false;
@@ -1081,13 +1709,16 @@ void switchMainLoop(flowTableEntry firstEntry, int switchNumber, string trafficF
     message entry;
     entry.aMessage = firstEntry;
     connectionInfo.push_back(entry);
+    buildFlowTableSoA(flowTable, connectionInfo);
+    classifierMode = selectClassifyMode(flowTable);
 
-    // set up signal handler for USER1
-    if (signal(SIGUSR1, user1SignalHandler) == SIG_ERR)
+    // receive USER1 through a signalfd and serve metrics on a unix socket
+    ostringstream name;
+    name << "sw" << switchNumber;
+    if (!openEventSources(name.str()))
     {
-        cout << "Problem setting signal handler for USER1" << endl;
         return;
-    }  
+    }
 
     // open and connect the TCP socket to the controller
     int fd;
@@ -1202,8 +1833,13 @@ void switchMainLoop(flowTableEntry firstEntry, int switchNumber, string trafficF
             cout << endl << "** Delay period has ended." << endl;
         }
 
-        // if the switch has been acknowledged, is not delayed, and has not finished processing the traffic file
-        if (acknowledged && !finished && !delayed)
+        // send what the neighbours can take from the link queues and apply backpressure
+        flushLinkQueues(switchNumber);
+        checkBackpressure(switchNumber);
+
+        // if the switch has been acknowledged, is not delayed, has not finished processing the traffic file
+        // and has not paused its own traffic for backpressure
+        if (acknowledged && !finished && !delayed && !upstreamPaused)
         {
             // read a valid line from traffic file
             char buf[MAXLINE];
@@ -1255,8 +1891,10 @@ void switchMainLoop(flowTableEntry firstEntry, int switchNumber, string trafficF
             }
         }
 
-        // poll the user
+        // poll the user, signals and metrics clients
         pollUserInput(swFDS, numInFIFOS);
+        pollSignals();
+        pollMetricsSocket();
 
         // poll the open socket and fifos
         if (poll(swFDS, numInFIFOS, 0) > 0)
@@ -1267,9 +1905,44 @@ void switchMainLoop(flowTableEntry firstEntry, int switchNumber, string trafficF
                 // an event occurred in one of the fds
                 for (int i = 0; i < numInFIFOS; ++i)
                 {
-                    if ((swFDS[i].revents & (POLLIN | POLLPRI)) > 0)
+                    if ((swFDS[i].revents & (POLLIN | POLLPRI)) > 0 && i > 0)
                     {
-                                            // a packet was received from the controller
+                        // drain up to a batch of packets from the fifo and classify them together
+                        packet batch[CLASSIFY_BATCH];
+                        if ((numberBytes = read(swFDS[i].fd, (char*) batch, sizeof(batch))) < 0)
+                        {
+                            cout << "Error occurred during read from " << i << endl;
+                            continue;
+                        }
+                        else if (numberBytes == 0)
+                        {
+                            // this should never happen as they are fifos not sockets
+                            cout << "Connection to switch " << i << " was lost." << endl;
+                            close(swFDS[i].fd);
+                            swFDS[i].events = 0;
+                            continue;
+                        }
+                        // fifo writes of a single packet are atomic so only whole packets are read
+                        int numPackets = numberBytes / sizeof(packet);
+                        queryRelayMessage batchMessages[CLASSIFY_BATCH];
+                        int batchRules[CLASSIFY_BATCH];
+                        for (int j = 0; j < numPackets; ++j)
+                        {
+                            batchMessages[j] = batch[j].msg.qrMessage;
+                        }
+                        classifyBatch(flowTable, batchMessages, numPackets, batchRules, classifierMode);
+                        for (int j = 0; j < numPackets; ++j)
+                        {
+                            if (batch[j].type != RELAY)
+                            {
+                                batchRules[j] = UNCLASSIFIED;
+                            }
+                            processPacket(batch[j], switchNumber, port1Switch, port2Switch, connectedNumbers[i], 0, batchRules[j]);
+                        }
+                    }
+                    else if ((swFDS[i].revents & (POLLIN | POLLPRI)) > 0)
+                    {
+                        // a packet was received from the controller
                         if ((numberBytes = read(swFDS[i].fd, (char*) &inPacket, sizeof(packet))) < 0)
                         {
                             cout << "Error occurred during read from " << i << endl;
@@ -1329,8 +2002,18 @@ int main(int argc, char *argv[])
 {   
     string switchType;
     bool status;
+
+    // every queued packet comes from the pool, nothing is allocated per packet after this
+    initPacketPool(queuePool);
+    initPacketList(packetQueue);
+    initQueryTable(sentQueries);
+    for (int i = 0; i <= MAX_NSW; ++i)
+    {
+        initPacketList(linkQueues[i]);
+        pausedLinks[i] = false;
+    }
     
-    if (argc == 4) 
+    if (argc == 4 || argc == 5) 
     {
         // correct number of arguments for controller
 
@@ -1351,11 +2034,24 @@ int main(int argc, char *argv[])
 
         // used port number 9297
         int portNumber = atoi(argv[3]);
+
+        // optional query coalescing window in milliseconds, by default every query is answered
+        // immediately
+        int coalesceMsec = QUERY_COALESCE_MSEC;
+        if (argc == 5)
+        {
+            coalesceMsec = atoi(argv[4]);
+            if (coalesceMsec < 0)
+            {
+                cout << "Invalid query coalescing window specified." << endl;
+                return 0;
+            }
+        }
         
         // begin controller main loop
-        controllerMainLoop(numSwitches, portNumber);
+        controllerMainLoop(numSwitches, portNumber, coalesceMsec);
     }
-    else if (argc == 8) 
+    else if (argc == 8 || argc == 9) 
     {
         // correct number of arguments for switch
         int switchNumber;
@@ -1405,8 +2101,28 @@ int main(int argc, char *argv[])
         char *serverAddress = argv[6];
         int portNumber = atoi(argv[7]);
 
+        // optional queue policy: tail, head or backpressure
+        queuePolicy policy = TAILDROP;
+        if (argc == 9)
+        {
+            string policyName = argv[8];
+            if (policyName.compare(QUEUEPOLICYNAME[HEADDROP]) == 0)
+            {
+                policy = HEADDROP;
+            }
+            else if (policyName.compare(QUEUEPOLICYNAME[BACKPRESSURE]) == 0)
+            {
+                policy = BACKPRESSURE;
+            }
+            else if (policyName.compare(QUEUEPOLICYNAME[TAILDROP]) != 0)
+            {
+                cout << "Invalid queue policy: " << policyName << endl;
+                return 1;
+            }
+        }
+
         // begin the switch main loop
-        switchMainLoop(firstEntry, switchNumber, trafficFile, port1Switch, port2Switch, serverAddress, portNumber);
+        switchMainLoop(firstEntry, switchNumber, trafficFile, port1Switch, port2Switch, serverAddress, portNumber, policy);
     } 
     else 
     {
@@ -0,0 +1,159 @@
+/*
+Microbenchmark for the flow table classifier used by the a3sdn switches.
+
+Builds random flow tables of overlapping (srcIP range, destIP range, pri) rules and
+reports the number of packets classified per second for each classifier, from the
+linear scans (scalar, SSE4, AVX2) to the compiled HiCuts decision tree, the direct-mapped
+table and the multibit trie.
+
+usage: classbench [numPackets]
+*/
+
+#include "libraries.h"
+#include "constants.h"
+#include "packets.h"
+#include "flowtable.h"
+
+#include <sys/time.h>
+
+// table sizes measured by the benchmark
+const int TABLESIZES[4] = {10, 100, 1000, 10000};
+
+// returns the current time in seconds
+double currentTime()
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return now.tv_sec + now.tv_usec / 1000000.0;
+}
+
+// creates a random range inside [0, MAXIP]
+void randomRange(int &lo, int &hi)
+{
+    lo = rand() % (MAXIP + 1);
+    hi = lo + rand() % (MAXIP / 10);
+    if (hi > MAXIP)
+    {
+        hi = MAXIP;
+    }
+}
+
+// creates a flow table of random overlapping rules
+void createRandomRules(vector<message> &rules, int numRules)
+{
+    rules.clear();
+    for (int i = 0; i < numRules; ++i)
+    {
+        int srcIPLo, srcIPHi, destIPLo, destIPHi;
+        randomRange(srcIPLo, srcIPHi);
+        randomRange(destIPLo, destIPHi);
+        packet rule = createAMessagePacket(ADD, srcIPLo, srcIPHi, destIPLo, destIPHi, FORWARD, 1 + rand() % 3, rand() % (MINPRI + 1), 0);
+        rules.push_back(rule.msg);
+    }
+}
+
+// classifies every packet in batches and returns the number of packets classified per second
+double benchmarkClassifier(const flowTableSoA &ft, const vector<queryRelayMessage> &msgs, vector<int> &results, classifyMode mode)
+{
+    double start = currentTime();
+    classifyBatch(ft, &msgs[0], msgs.size(), &results[0], mode);
+    double elapsed = currentTime() - start;
+    return msgs.size() / elapsed;
+}
+
+// times keeping a decision tree in step as the rules are added one at a time, as a classifier
+// without a direct-mapped table would, rebuilding the tree whenever an insert asks for it
+double timeTreeAdds(const vector<message> &rules)
+{
+    flowTableSoA ft;
+    buildFlowTableSoA(ft, vector<message>());
+    hicutsTree *tree = NULL;
+    double elapsed = 0;
+    for (int i = 0; i < rules.size(); ++i)
+    {
+        appendFlowTableSoA(ft, rules[i].aMessage);
+        double start = currentTime();
+        if (tree == NULL || !insertHiCutsRule(tree, ft, i))
+        {
+            deleteHiCutsTree(tree);
+            tree = buildHiCutsTree(ft);
+        }
+        elapsed += currentTime() - start;
+    }
+    deleteHiCutsTree(tree);
+    return elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+    int numPackets = 200000;
+    if (argc == 2)
+    {
+        numPackets = atoi(argv[1]);
+    }
+    srand(379);
+
+    // random packets, some of which miss every rule
+    vector<queryRelayMessage> msgs(numPackets);
+    for (int i = 0; i < numPackets; ++i)
+    {
+        msgs[i].srcIP = rand() % (MAXIP + 1);
+        msgs[i].destIP = rand() % (MAXIP + 1);
+    }
+
+    classifyMode bestMode = bestClassifyMode();
+    cout << "Classifying " << numPackets << " packets, best instruction set: " << CLASSIFYMODENAME[bestMode] << endl << endl;
+    cout << "rules     mode      packets/sec" << endl;
+
+    for (int t = 0; t < 4; ++t)
+    {
+        vector<message> rules;
+        createRandomRules(rules, TABLESIZES[t]);
+
+        // time adding the rules one at a time as a switch would
+        flowTableSoA ft;
+        double start = currentTime();
+        buildFlowTableSoA(ft, rules);
+        double insertTime = currentTime() - start;
+        double treeInsertTime = timeTreeAdds(rules);
+
+        // time a single full build of each compiled classifier
+        start = currentTime();
+        compileFlowTable(ft);
+        double compileTime = currentTime() - start;
+        start = currentTime();
+        compileDirectMap(ft);
+        double denseTime = currentTime() - start;
+        start = currentTime();
+        compileTrie(ft);
+        double trieTime = currentTime() - start;
+
+        // fewer packets on the larger tables so the scalar classifier finishes in reasonable time
+        vector<queryRelayMessage> tableMsgs(msgs.begin(), msgs.begin() + max(1000, numPackets / max(1, TABLESIZES[t] / 100)));
+        vector<int> expected(tableMsgs.size());
+        vector<int> results(tableMsgs.size());
+
+        for (int mode = SCALAR; mode <= TRIE; ++mode)
+        {
+            if (mode > bestMode && mode < HICUTS)
+            {
+                // instruction set not supported on this cpu
+                continue;
+            }
+            double rate = benchmarkClassifier(ft, tableMsgs, mode == SCALAR ? expected : results, (classifyMode) mode);
+            printf("%-9d %-9s %12.0f\n", TABLESIZES[t], CLASSIFYMODENAME[mode].c_str(), rate);
+
+            // every classifier must pick the same rule as the scalar one
+            if (mode != SCALAR && results != expected)
+            {
+                cout << "ERROR: " << CLASSIFYMODENAME[mode] << " classifier disagrees with the scalar classifier" << endl;
+                return 1;
+            }
+        }
+        printf("%-9d tree depth= %d, nodes= %d, build= %.3f ms, incremental adds= %.3f ms\n", TABLESIZES[t],
+               ft.tree->depth, (int) ft.tree->nodes.size(), compileTime * 1000, treeInsertTime * 1000);
+        printf("%-9d direct map buckets= %d (%lld KB, build= %.3f ms, incremental adds= %.3f ms), trie nodes= %d (build= %.3f ms)\n", TABLESIZES[t],
+               ft.dense->numBuckets, directMapBytes(ft.dense->numBuckets) / 1024, denseTime * 1000, insertTime * 1000, (int) ft.trie->nodes.size(), trieTime * 1000);
+    }
+    return 0;
+}
@@ -7,6 +7,18 @@
 #define MINPRI 4 // not tested in assignment, important when controller issues overlapping rules
 
 #define MAX_FLOWTABLE_SIZE 100
+#define DIRECTMAP_BUDGET (8 * 1024 * 1024) // most bytes a switch spends on its direct-mapped lookup table
+#define QUERY_COALESCE_MSEC 0 // default window in which the controller groups queries before answering them, 0 for none
+
+// switch queue bounds
+#define MAX_QUEUED_PACKETS 64   // packets waiting for a rule
+#define MAX_QUEUED_PER_DEST 16  // packets waiting for a rule to a single destIP
+#define MAX_LINK_QUEUE 32       // packets waiting for a neighbouring switch's fifo
+#define BACKPRESSURE_HIGH 48    // queued packets at which the upstream switches are paused
+#define BACKPRESSURE_LOW 16     // queued packets at which they are resumed
+
+#define METRICS_SOCKET_DIR "/tmp" // unix socket serving a metrics snapshot is METRICS_SOCKET_DIR/a3sdn-<name>.sock
+
 #define NETPORT 21
 #define FILEPORT 22
 
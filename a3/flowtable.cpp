@@ -0,0 +1,852 @@
+#include "flowtable.h"
+#include "constants.h"
+
+#include <climits>
+#include <immintrin.h>
+
+// number of rules compared per AVX2 vector, the arrays are padded to a multiple of this
+#define LANES 8
+
+// the low bits of a priority key hold the rule index, the high bits hold the inverted priority
+#define KEY_INDEX_BITS 23
+#define KEY_MAX_PRI 255
+
+// hicuts build parameters
+#define HICUTS_BINTH 32      // a node with at most this many rules becomes a leaf
+#define HICUTS_SPFAC 8      // space factor bounding the rule copies made by a cut
+#define HICUTS_MAX_CUTS 64
+#define HICUTS_MAX_DEPTH 16
+#define HICUTS_REBUILD_GROWTH 2 // a degraded tree is rebuilt once the table has grown this many times since the last build
+
+// multibit trie shape, 4 levels of 256-way nodes below the root cover the 32 bits of destIP
+#define TRIE_STRIDE 8
+#define TRIE_LEVELS 4
+
+// builds the priority key of a rule, see flowtable.h
+int ruleKey(int pri, int index)
+{
+    if (pri < 0)
+    {
+        pri = 0;
+    }
+    else if (pri > KEY_MAX_PRI)
+    {
+        pri = KEY_MAX_PRI;
+    }
+    return ((KEY_MAX_PRI - pri) << KEY_INDEX_BITS) | index;
+}
+
+// returns the flow table index held in a priority key
+int ruleIndexFromKey(int key)
+{
+    if (key < 0)
+    {
+        return NO_RULE;
+    }
+    return key & ((1 << KEY_INDEX_BITS) - 1);
+}
+
+// adds a block of padding lanes that can never match a packet
+void padFlowTableSoA(flowTableSoA &ft)
+{
+    for (int i = 0; i < LANES; ++i)
+    {
+        ft.srcIPLo.push_back(INT_MAX);
+        ft.srcIPHi.push_back(INT_MIN);
+        ft.destIPLo.push_back(INT_MAX);
+        ft.destIPHi.push_back(INT_MIN);
+        ft.key.push_back(NO_RULE);
+    }
+}
+
+// copies the flow table rules into the structure-of-arrays used by the classifier
+void buildFlowTableSoA(flowTableSoA &ft, const vector<message> &rules)
+{
+    ft.srcIPLo.clear();
+    ft.srcIPHi.clear();
+    ft.destIPLo.clear();
+    ft.destIPHi.clear();
+    ft.key.clear();
+    ft.numRules = 0;
+    ft.tree = NULL;
+    ft.dense = NULL;
+    ft.trie = NULL;
+    for (int i = 0; i < rules.size(); ++i)
+    {
+        appendFlowTableSoA(ft, rules[i].aMessage);
+    }
+}
+
+// adds a new rule to the end of the structure-of-arrays, called when a switch receives an ADD
+void appendFlowTableSoA(flowTableSoA &ft, flowTableEntry rule)
+{
+    if (ft.numRules == ft.key.size())
+    {
+        // every lane is in use, grow by one vector
+        padFlowTableSoA(ft);
+    }
+    int i = ft.numRules;
+    ft.srcIPLo[i] = rule.srcIPLo;
+    ft.srcIPHi[i] = rule.srcIPHi;
+    ft.destIPLo[i] = rule.destIPLo;
+    ft.destIPHi[i] = rule.destIPHi;
+    ft.key[i] = ruleKey(rule.pri, i);
+    ft.numRules += 1;
+
+    // a decision tree is not kept in step, it is never the selected classifier once the direct-mapped
+    // table or the trie exists, and rebuilding it on an ADD would stall the switch
+    deleteHiCutsTree(ft.tree);
+    ft.tree = NULL;
+
+    // keep the compiled classifiers in step with the table
+    if (ft.trie != NULL)
+    {
+        // the direct-mapped table has already outgrown its budget
+        insertTrieRule(ft.trie, ft, i);
+        return;
+    }
+    if (ft.dense == NULL)
+    {
+        compileDirectMap(ft);
+    }
+    else if (!insertDirectMapRule(ft.dense, ft, i))
+    {
+        delete ft.dense;
+        ft.dense = NULL;
+    }
+    if (ft.dense == NULL)
+    {
+        // over the memory budget, switch to the trie for good
+        compileTrie(ft);
+    }
+}
+
+// builds a new decision tree for the flow table and swaps it in place of the old one
+void compileFlowTable(flowTableSoA &ft)
+{
+    hicutsTree *newTree = buildHiCutsTree(ft);
+    hicutsTree *oldTree = ft.tree;
+    ft.tree = newTree;
+    deleteHiCutsTree(oldTree);
+}
+
+// picks the widest instruction set supported by the cpu
+classifyMode bestClassifyMode()
+{
+    static int mode = -1;
+    if (mode == -1)
+    {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+        {
+            mode = AVX2;
+        }
+        else if (__builtin_cpu_supports("sse4.1"))
+        {
+            mode = SSE4;
+        }
+        else
+        {
+            mode = SCALAR;
+        }
+    }
+    return (classifyMode) mode;
+}
+
+// picks the classifier for the flow table
+// the direct-mapped table if it fits in its budget, otherwise the trie
+classifyMode selectClassifyMode(const flowTableSoA &ft)
+{
+    if (ft.dense != NULL)
+    {
+        return DIRECT;
+    }
+    if (ft.trie != NULL)
+    {
+        return TRIE;
+    }
+    if (ft.tree != NULL)
+    {
+        return HICUTS;
+    }
+    return bestClassifyMode();
+}
+
+// hicuts functions
+// returns true if a rule overlaps the region of a node
+bool ruleOverlapsNode(const flowTableSoA &ft, int ruleIndex, const hicutsNode &node)
+{
+    return ft.srcIPLo[ruleIndex] <= node.hi[0] && ft.srcIPHi[ruleIndex] >= node.lo[0] &&
+           ft.destIPLo[ruleIndex] <= node.hi[1] && ft.destIPHi[ruleIndex] >= node.lo[1];
+}
+
+// returns true if a rule covers the whole region of a node
+bool ruleCoversNode(const flowTableSoA &ft, int ruleIndex, const hicutsNode &node)
+{
+    return ft.srcIPLo[ruleIndex] <= node.lo[0] && ft.srcIPHi[ruleIndex] >= node.hi[0] &&
+           ft.destIPLo[ruleIndex] <= node.lo[1] && ft.destIPHi[ruleIndex] >= node.hi[1];
+}
+
+// returns the lowest and highest value of a rule along a dimension
+void ruleBounds(const flowTableSoA &ft, int ruleIndex, int dim, int &lo, int &hi)
+{
+    if (dim == 0)
+    {
+        lo = ft.srcIPLo[ruleIndex];
+        hi = ft.srcIPHi[ruleIndex];
+    }
+    else
+    {
+        lo = ft.destIPLo[ruleIndex];
+        hi = ft.destIPHi[ruleIndex];
+    }
+}
+
+// returns the slice of a node containing value along the node's cut dimension
+int childSlice(const hicutsNode &node, int dim, int value)
+{
+    return (int) (((long long) value - node.lo[dim]) / node.cutWidth);
+}
+
+// returns the number of rule copies the children would hold if a node was cut numCuts ways along dim
+long long cutCost(const flowTableSoA &ft, const hicutsNode &node, int dim, int numCuts, long long cutWidth)
+{
+    long long cost = numCuts;
+    for (int i = 0; i < node.rules.size(); ++i)
+    {
+        int lo, hi;
+        ruleBounds(ft, node.rules[i], dim, lo, hi);
+        lo = max(lo, node.lo[dim]);
+        hi = min(hi, node.hi[dim]);
+        cost += (((long long) hi - node.lo[dim]) / cutWidth) - (((long long) lo - node.lo[dim]) / cutWidth) + 1;
+    }
+    return cost;
+}
+
+// sorts the rules of a leaf best key first and drops the rules hidden behind a rule covering the leaf
+// a terminal leaf is one that cutting would not shrink
+void finishLeaf(const flowTableSoA &ft, hicutsNode &node, bool terminal)
+{
+    node.dim = -1;
+    node.terminal = terminal;
+    vector<pair<int, int> > byKey;
+    for (int i = 0; i < node.rules.size(); ++i)
+    {
+        byKey.push_back(pair<int, int>(ft.key[node.rules[i]], node.rules[i]));
+    }
+    sort(byKey.rbegin(), byKey.rend());
+
+    node.rules.clear();
+    for (int i = 0; i < byKey.size(); ++i)
+    {
+        node.rules.push_back(byKey[i].second);
+        if (ruleCoversNode(ft, byKey[i].second, node))
+        {
+            break;
+        }
+    }
+}
+
+// recursively cuts a node until its rules fit in a leaf
+void buildHiCutsNode(hicutsTree *tree, const flowTableSoA &ft, int nodeIndex, int depth)
+{
+    hicutsNode &node = tree->nodes[nodeIndex];
+    if (depth > tree->depth)
+    {
+        tree->depth = depth;
+    }
+    if (node.rules.size() <= HICUTS_BINTH || depth >= HICUTS_MAX_DEPTH)
+    {
+        finishLeaf(ft, node, depth >= HICUTS_MAX_DEPTH);
+        return;
+    }
+
+    // cut along the dimension with the most distinct rule edges inside the region
+    int dim = 0;
+    int mostEdges = -1;
+    for (int d = 0; d < 2; ++d)
+    {
+        set<int> edges;
+        for (int i = 0; i < node.rules.size(); ++i)
+        {
+            int lo, hi;
+            ruleBounds(ft, node.rules[i], d, lo, hi);
+            edges.insert(max(lo, node.lo[d]));
+            edges.insert(min(hi, node.hi[d]));
+        }
+        if ((int) edges.size() > mostEdges && node.hi[d] > node.lo[d])
+        {
+            mostEdges = edges.size();
+            dim = d;
+        }
+    }
+    long long span = (long long) node.hi[dim] - node.lo[dim] + 1;
+    if (span < 2)
+    {
+        finishLeaf(ft, node, true);
+        return;
+    }
+
+    // keep doubling the number of cuts while the rule copies stay within the space factor
+    int numCuts = 2;
+    while (numCuts * 2 <= HICUTS_MAX_CUTS && numCuts * 2 <= span)
+    {
+        long long width = (span + numCuts * 2 - 1) / (numCuts * 2);
+        if (cutCost(ft, node, dim, numCuts * 2, width) > (long long) HICUTS_SPFAC * node.rules.size())
+        {
+            break;
+        }
+        numCuts *= 2;
+    }
+    long long cutWidth = (span + numCuts - 1) / numCuts;
+    numCuts = (int) ((span + cutWidth - 1) / cutWidth);
+
+    // create the children, they are contiguous in the node array
+    int firstChild = tree->nodes.size();
+    bool progress = false;
+    for (int k = 0; k < numCuts; ++k)
+    {
+        hicutsNode child;
+        child.dim = -1;
+        child.lo[0] = tree->nodes[nodeIndex].lo[0];
+        child.hi[0] = tree->nodes[nodeIndex].hi[0];
+        child.lo[1] = tree->nodes[nodeIndex].lo[1];
+        child.hi[1] = tree->nodes[nodeIndex].hi[1];
+        child.lo[dim] = (int) (tree->nodes[nodeIndex].lo[dim] + k * cutWidth);
+        child.hi[dim] = (int) min((long long) tree->nodes[nodeIndex].hi[dim], tree->nodes[nodeIndex].lo[dim] + (k + 1) * cutWidth - 1);
+        child.numCuts = 0;
+        child.cutWidth = 0;
+        child.firstChild = -1;
+        child.terminal = false;
+        for (int i = 0; i < tree->nodes[nodeIndex].rules.size(); ++i)
+        {
+            if (ruleOverlapsNode(ft, tree->nodes[nodeIndex].rules[i], child))
+            {
+                child.rules.push_back(tree->nodes[nodeIndex].rules[i]);
+            }
+        }
+        if (child.rules.size() < tree->nodes[nodeIndex].rules.size())
+        {
+            progress = true;
+        }
+        tree->nodes.push_back(child);
+    }
+    if (!progress)
+    {
+        // every child overlaps every rule, cutting further does not help
+        tree->nodes.resize(firstChild);
+        finishLeaf(ft, tree->nodes[nodeIndex], true);
+        return;
+    }
+
+    // push_back may have moved the node array so index it again
+    tree->nodes[nodeIndex].dim = dim;
+    tree->nodes[nodeIndex].numCuts = numCuts;
+    tree->nodes[nodeIndex].cutWidth = cutWidth;
+    tree->nodes[nodeIndex].firstChild = firstChild;
+    tree->nodes[nodeIndex].rules.clear();
+    for (int k = 0; k < numCuts; ++k)
+    {
+        buildHiCutsNode(tree, ft, firstChild + k, depth + 1);
+    }
+}
+
+// builds a decision tree covering every rule of the flow table
+hicutsTree *buildHiCutsTree(const flowTableSoA &ft)
+{
+    hicutsTree *tree = new hicutsTree;
+    tree->depth = 0;
+    tree->numRules = ft.numRules;
+    tree->degraded = false;
+
+    // the root covers the bounding box of every rule
+    hicutsNode root;
+    root.dim = -1;
+    root.lo[0] = root.lo[1] = 0;
+    root.hi[0] = root.hi[1] = MAXIP;
+    root.numCuts = 0;
+    root.cutWidth = 0;
+    root.firstChild = -1;
+    root.terminal = false;
+    for (int i = 0; i < ft.numRules; ++i)
+    {
+        root.lo[0] = min(root.lo[0], ft.srcIPLo[i]);
+        root.hi[0] = max(root.hi[0], ft.srcIPHi[i]);
+        root.lo[1] = min(root.lo[1], ft.destIPLo[i]);
+        root.hi[1] = max(root.hi[1], ft.destIPHi[i]);
+        root.rules.push_back(i);
+    }
+    tree->nodes.push_back(root);
+    buildHiCutsNode(tree, ft, 0, 0);
+    return tree;
+}
+
+// inserts a rule into every leaf it overlaps below a node
+// returns false if a leaf that could still be cut has grown too large
+bool insertHiCutsRuleAt(hicutsTree *tree, const flowTableSoA &ft, int nodeIndex, int ruleIndex)
+{
+    hicutsNode &node = tree->nodes[nodeIndex];
+    if (node.dim == -1)
+    {
+        // keep the leaf sorted best key first, the rule is hidden if a better rule covers the leaf
+        vector<int>::iterator it = node.rules.begin();
+        while (it != node.rules.end() && ft.key[*it] > ft.key[ruleIndex])
+        {
+            if (ruleCoversNode(ft, *it, node))
+            {
+                return true;
+            }
+            ++it;
+        }
+        node.rules.insert(it, ruleIndex);
+        return node.terminal || node.rules.size() <= 2 * HICUTS_BINTH;
+    }
+
+    // visit every child slice the rule overlaps
+    int lo, hi;
+    ruleBounds(ft, ruleIndex, node.dim, lo, hi);
+    int first = childSlice(node, node.dim, max(lo, node.lo[node.dim]));
+    int last = childSlice(node, node.dim, min(hi, node.hi[node.dim]));
+    bool ok = true;
+    for (int k = first; k <= last; ++k)
+    {
+        if (ruleOverlapsNode(ft, ruleIndex, tree->nodes[node.firstChild + k]))
+        {
+            ok = insertHiCutsRuleAt(tree, ft, node.firstChild + k, ruleIndex) && ok;
+        }
+    }
+    return ok;
+}
+
+// inserts a newly added rule into the tree, returns false if the tree should be rebuilt
+bool insertHiCutsRule(hicutsTree *tree, const flowTableSoA &ft, int ruleIndex)
+{
+    const hicutsNode &root = tree->nodes[0];
+    if (ft.srcIPLo[ruleIndex] < root.lo[0] || ft.srcIPHi[ruleIndex] > root.hi[0] ||
+        ft.destIPLo[ruleIndex] < root.lo[1] || ft.destIPHi[ruleIndex] > root.hi[1])
+    {
+        // the rule reaches outside the region the tree was built for
+        return false;
+    }
+    if (!insertHiCutsRuleAt(tree, ft, 0, ruleIndex))
+    {
+        tree->degraded = true;
+    }
+    // an overgrown leaf only slows lookups down, so the rebuild waits until its cost is
+    // spread over enough new rules
+    return !tree->degraded || ft.numRules < HICUTS_REBUILD_GROWTH * tree->numRules;
+}
+
+// frees a decision tree
+void deleteHiCutsTree(hicutsTree *tree)
+{
+    delete tree;
+}
+
+// walks the decision tree down to a leaf and returns the first matching rule in it
+int classifyHiCuts(const hicutsTree *tree, const flowTableSoA &ft, int srcIP, int destIP)
+{
+    int value[2] = {srcIP, destIP};
+    const hicutsNode *node = &tree->nodes[0];
+    if (srcIP < node->lo[0] || srcIP > node->hi[0] || destIP < node->lo[1] || destIP > node->hi[1])
+    {
+        return NO_RULE;
+    }
+    while (node->dim != -1)
+    {
+        node = &tree->nodes[node->firstChild + childSlice(*node, node->dim, value[node->dim])];
+    }
+    for (int i = 0; i < node->rules.size(); ++i)
+    {
+        int r = node->rules[i];
+        if (srcIP >= ft.srcIPLo[r] && srcIP <= ft.srcIPHi[r] && destIP >= ft.destIPLo[r] && destIP <= ft.destIPHi[r])
+        {
+            return r;
+        }
+    }
+    return NO_RULE;
+}
+// end hicuts functions
+
+// direct-mapped table functions
+// returns the bytes used by a direct-mapped table with numBuckets srcIP buckets
+long long directMapBytes(int numBuckets)
+{
+    return ((long long) numBuckets + 1) * (MAXIP + 1) * sizeof(int);
+}
+
+// makes edge the first srcIP of a bucket, splitting the bucket that contains it
+// returns false if the extra row would go over the memory budget
+bool splitDirectMapBucket(directMap *dense, int edge)
+{
+    if (edge <= 0 || edge > MAXIP || dense->srcBucket[edge - 1] != dense->srcBucket[edge])
+    {
+        // already the start of a bucket
+        return true;
+    }
+    if (directMapBytes(dense->numBuckets + 1) > DIRECTMAP_BUDGET)
+    {
+        return false;
+    }
+
+    // the new bucket is covered by the same rules as the old one, so it starts as a copy of its row
+    int oldBucket = dense->srcBucket[edge];
+    int newBucket = dense->numBuckets;
+    dense->numBuckets += 1;
+    dense->table.resize((long long) dense->numBuckets * (MAXIP + 1));
+    copy(dense->table.begin() + (long long) oldBucket * (MAXIP + 1),
+         dense->table.begin() + (long long) (oldBucket + 1) * (MAXIP + 1),
+         dense->table.begin() + (long long) newBucket * (MAXIP + 1));
+    for (int ip = edge; ip <= MAXIP && dense->srcBucket[ip] == oldBucket; ++ip)
+    {
+        dense->srcBucket[ip] = newBucket;
+    }
+    return true;
+}
+
+// paints a rule over the rows of the buckets its srcIP range covers
+// returns false if the table would go over the memory budget
+bool insertDirectMapRule(directMap *dense, const flowTableSoA &ft, int ruleIndex)
+{
+    // only the part of the rule inside [0, MAXIP] is held in the table
+    int srcLo = max(ft.srcIPLo[ruleIndex], 0);
+    int srcHi = min(ft.srcIPHi[ruleIndex], MAXIP);
+    int destLo = max(ft.destIPLo[ruleIndex], 0);
+    int destHi = min(ft.destIPHi[ruleIndex], MAXIP);
+    if (srcLo > srcHi || destLo > destHi)
+    {
+        return true;
+    }
+    if (!splitDirectMapBucket(dense, srcLo) || !splitDirectMapBucket(dense, srcHi + 1))
+    {
+        return false;
+    }
+
+    int ip = srcLo;
+    while (ip <= srcHi)
+    {
+        int bucket = dense->srcBucket[ip];
+        int *row = &dense->table[(long long) bucket * (MAXIP + 1)];
+        for (int destIP = destLo; destIP <= destHi; ++destIP)
+        {
+            if (row[destIP] == NO_RULE || ft.key[row[destIP]] < ft.key[ruleIndex])
+            {
+                row[destIP] = ruleIndex;
+            }
+        }
+        // skip the rest of the bucket
+        while (ip <= srcHi && dense->srcBucket[ip] == bucket)
+        {
+            ip += 1;
+        }
+    }
+    return true;
+}
+
+// builds the direct-mapped table for the flow table, leaves it NULL if it does not fit in the budget
+void compileDirectMap(flowTableSoA &ft)
+{
+    delete ft.dense;
+    ft.dense = NULL;
+    if (directMapBytes(1) > DIRECTMAP_BUDGET)
+    {
+        return;
+    }
+
+    // start with every srcIP in one bucket and no rules
+    directMap *dense = new directMap;
+    dense->srcBucket.assign(MAXIP + 1, 0);
+    dense->table.assign(MAXIP + 1, NO_RULE);
+    dense->numBuckets = 1;
+    for (int i = 0; i < ft.numRules; ++i)
+    {
+        if (!insertDirectMapRule(dense, ft, i))
+        {
+            delete dense;
+            return;
+        }
+    }
+    ft.dense = dense;
+}
+
+// returns the rule for a packet from the direct-mapped table
+// UNCLASSIFIED if the packet is outside the table
+int classifyDirectMap(const directMap *dense, int srcIP, int destIP)
+{
+    if (srcIP < 0 || srcIP > MAXIP || destIP < 0 || destIP > MAXIP)
+    {
+        return UNCLASSIFIED;
+    }
+    return dense->table[(long long) dense->srcBucket[srcIP] * (MAXIP + 1) + destIP];
+}
+// end direct-mapped table functions
+
+// multibit trie functions
+// stores a rule in the nodes below nodeIndex whose destIP range it covers completely
+void insertTrieRuleAt(multibitTrie *trie, const flowTableSoA &ft, int nodeIndex, int level, unsigned long long base,
+                      unsigned long long lo, unsigned long long hi, int ruleIndex)
+{
+    int shift = TRIE_STRIDE * (TRIE_LEVELS - level);
+    unsigned long long end = base + (1ULL << shift) - 1;
+    if (lo <= base && hi >= end)
+    {
+        // keep the node's rules sorted best key first
+        vector<int> &rules = trie->nodes[nodeIndex].rules;
+        vector<int>::iterator it = rules.begin();
+        while (it != rules.end() && ft.key[*it] > ft.key[ruleIndex])
+        {
+            ++it;
+        }
+        rules.insert(it, ruleIndex);
+        return;
+    }
+
+    if (trie->nodes[nodeIndex].firstChild == -1)
+    {
+        trieNode child;
+        child.firstChild = -1;
+        trie->nodes[nodeIndex].firstChild = trie->nodes.size();
+        trie->nodes.resize(trie->nodes.size() + (1 << TRIE_STRIDE), child);
+    }
+    int firstChild = trie->nodes[nodeIndex].firstChild;
+    int childShift = shift - TRIE_STRIDE;
+    int first = (int) ((max(lo, base) - base) >> childShift);
+    int last = (int) ((min(hi, end) - base) >> childShift);
+    for (int k = first; k <= last; ++k)
+    {
+        insertTrieRuleAt(trie, ft, firstChild + k, level + 1, base + ((unsigned long long) k << childShift), lo, hi, ruleIndex);
+    }
+}
+
+// inserts a rule into the trie, IPs are never negative so the negative part of a range is ignored
+void insertTrieRule(multibitTrie *trie, const flowTableSoA &ft, int ruleIndex)
+{
+    if (ft.destIPHi[ruleIndex] < 0)
+    {
+        return;
+    }
+    unsigned long long lo = max(ft.destIPLo[ruleIndex], 0);
+    unsigned long long hi = ft.destIPHi[ruleIndex];
+    insertTrieRuleAt(trie, ft, 0, 0, 0, lo, hi, ruleIndex);
+}
+
+// builds the multibit trie for the flow table
+void compileTrie(flowTableSoA &ft)
+{
+    delete ft.trie;
+    ft.trie = new multibitTrie;
+    trieNode root;
+    root.firstChild = -1;
+    ft.trie->nodes.push_back(root);
+    for (int i = 0; i < ft.numRules; ++i)
+    {
+        insertTrieRule(ft.trie, ft, i);
+    }
+}
+
+// walks the trie along destIP and returns the best rule matching srcIP in the visited nodes
+int classifyTrie(const multibitTrie *trie, const flowTableSoA &ft, int srcIP, int destIP)
+{
+    if (destIP < 0)
+    {
+        return NO_RULE;
+    }
+    int bestRule = NO_RULE;
+    int nodeIndex = 0;
+    for (int level = 0; ; ++level)
+    {
+        const trieNode &node = trie->nodes[nodeIndex];
+        for (int i = 0; i < node.rules.size(); ++i)
+        {
+            int r = node.rules[i];
+            if (srcIP >= ft.srcIPLo[r] && srcIP <= ft.srcIPHi[r])
+            {
+                if (bestRule == NO_RULE || ft.key[r] > ft.key[bestRule])
+                {
+                    bestRule = r;
+                }
+                break;
+            }
+        }
+        if (node.firstChild == -1)
+        {
+            break;
+        }
+        int childShift = TRIE_STRIDE * (TRIE_LEVELS - level - 1);
+        nodeIndex = node.firstChild + (((unsigned int) destIP >> childShift) & ((1 << TRIE_STRIDE) - 1));
+    }
+    return bestRule;
+}
+// end multibit trie functions
+
+// classifies up to CLASSIFY_BATCH packets one rule at a time
+void classifyBatchScalar(const flowTableSoA &ft, const queryRelayMessage msgs[], int numPackets, int bestKeys[])
+{
+    for (int p = 0; p < numPackets; ++p)
+    {
+        bestKeys[p] = NO_RULE;
+    }
+    for (int i = 0; i < ft.numRules; ++i)
+    {
+        for (int p = 0; p < numPackets; ++p)
+        {
+            if (msgs[p].srcIP >= ft.srcIPLo[i] && msgs[p].srcIP <= ft.srcIPHi[i] &&
+                msgs[p].destIP >= ft.destIPLo[i] && msgs[p].destIP <= ft.destIPHi[i] &&
+                ft.key[i] > bestKeys[p])
+            {
+                bestKeys[p] = ft.key[i];
+            }
+        }
+    }
+}
+
+// classifies up to CLASSIFY_BATCH packets four rules at a time
+// a rule that misses a packet has its key or'ed with the all-ones compare mask, which is NO_RULE,
+// so the best matching rule is a plain max over the candidate keys
+__attribute__((target("sse4.1")))
+void classifyBatchSSE4(const flowTableSoA &ft, const queryRelayMessage msgs[], int numPackets, int bestKeys[])
+{
+    __m128i src[CLASSIFY_BATCH];
+    __m128i dest[CLASSIFY_BATCH];
+    __m128i best[CLASSIFY_BATCH];
+    for (int p = 0; p < numPackets; ++p)
+    {
+        src[p] = _mm_set1_epi32(msgs[p].srcIP);
+        dest[p] = _mm_set1_epi32(msgs[p].destIP);
+        best[p] = _mm_set1_epi32(NO_RULE);
+    }
+
+    int numLanes = ft.key.size();
+    for (int i = 0; i < numLanes; i += 4)
+    {
+        __m128i srcLo = _mm_loadu_si128((const __m128i *) &ft.srcIPLo[i]);
+        __m128i srcHi = _mm_loadu_si128((const __m128i *) &ft.srcIPHi[i]);
+        __m128i destLo = _mm_loadu_si128((const __m128i *) &ft.destIPLo[i]);
+        __m128i destHi = _mm_loadu_si128((const __m128i *) &ft.destIPHi[i]);
+        __m128i key = _mm_loadu_si128((const __m128i *) &ft.key[i]);
+        for (int p = 0; p < numPackets; ++p)
+        {
+            __m128i miss = _mm_or_si128(_mm_or_si128(_mm_cmpgt_epi32(srcLo, src[p]), _mm_cmpgt_epi32(src[p], srcHi)),
+                                        _mm_or_si128(_mm_cmpgt_epi32(destLo, dest[p]), _mm_cmpgt_epi32(dest[p], destHi)));
+            best[p] = _mm_max_epi32(best[p], _mm_or_si128(key, miss));
+        }
+    }
+
+    // reduce the lanes of each packet to a single key
+    for (int p = 0; p < numPackets; ++p)
+    {
+        __m128i m = best[p];
+        m = _mm_max_epi32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(1, 0, 3, 2)));
+        m = _mm_max_epi32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(2, 3, 0, 1)));
+        bestKeys[p] = _mm_cvtsi128_si32(m);
+    }
+}
+
+// classifies up to CLASSIFY_BATCH packets eight rules at a time, same scheme as the SSE4 version
+__attribute__((target("avx2")))
+void classifyBatchAVX2(const flowTableSoA &ft, const queryRelayMessage msgs[], int numPackets, int bestKeys[])
+{
+    __m256i src[CLASSIFY_BATCH];
+    __m256i dest[CLASSIFY_BATCH];
+    __m256i best[CLASSIFY_BATCH];
+    for (int p = 0; p < numPackets; ++p)
+    {
+        src[p] = _mm256_set1_epi32(msgs[p].srcIP);
+        dest[p] = _mm256_set1_epi32(msgs[p].destIP);
+        best[p] = _mm256_set1_epi32(NO_RULE);
+    }
+
+    int numLanes = ft.key.size();
+    for (int i = 0; i < numLanes; i += LANES)
+    {
+        __m256i srcLo = _mm256_loadu_si256((const __m256i *) &ft.srcIPLo[i]);
+        __m256i srcHi = _mm256_loadu_si256((const __m256i *) &ft.srcIPHi[i]);
+        __m256i destLo = _mm256_loadu_si256((const __m256i *) &ft.destIPLo[i]);
+        __m256i destHi = _mm256_loadu_si256((const __m256i *) &ft.destIPHi[i]);
+        __m256i key = _mm256_loadu_si256((const __m256i *) &ft.key[i]);
+        for (int p = 0; p < numPackets; ++p)
+        {
+            __m256i miss = _mm256_or_si256(_mm256_or_si256(_mm256_cmpgt_epi32(srcLo, src[p]), _mm256_cmpgt_epi32(src[p], srcHi)),
+                                           _mm256_or_si256(_mm256_cmpgt_epi32(destLo, dest[p]), _mm256_cmpgt_epi32(dest[p], destHi)));
+            best[p] = _mm256_max_epi32(best[p], _mm256_or_si256(key, miss));
+        }
+    }
+
+    // reduce the lanes of each packet to a single key
+    for (int p = 0; p < numPackets; ++p)
+    {
+        __m128i m = _mm_max_epi32(_mm256_castsi256_si128(best[p]), _mm256_extracti128_si256(best[p], 1));
+        m = _mm_max_epi32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(1, 0, 3, 2)));
+        m = _mm_max_epi32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(2, 3, 0, 1)));
+        bestKeys[p] = _mm_cvtsi128_si32(m);
+    }
+}
+
+// finds the flow table index of the best rule for each packet, NO_RULE if none match
+void classifyBatch(const flowTableSoA &ft, const queryRelayMessage msgs[], int numPackets, int ruleIndices[], classifyMode mode)
+{
+    int bestKeys[CLASSIFY_BATCH];
+    for (int start = 0; start < numPackets; start += CLASSIFY_BATCH)
+    {
+        int count = min(CLASSIFY_BATCH, numPackets - start);
+        if (mode == DIRECT && ft.dense != NULL)
+        {
+            for (int p = 0; p < count; ++p)
+            {
+                int ruleIndex = classifyDirectMap(ft.dense, msgs[start + p].srcIP, msgs[start + p].destIP);
+                if (ruleIndex == UNCLASSIFIED)
+                {
+                    // outside the table, fall back to the tree or the linear scan
+                    classifyMode fallback = (ft.tree != NULL) ? HICUTS : bestClassifyMode();
+                    classifyBatch(ft, &msgs[start + p], 1, &ruleIndex, fallback);
+                }
+                ruleIndices[start + p] = ruleIndex;
+            }
+            continue;
+        }
+        else if (mode == TRIE && ft.trie != NULL)
+        {
+            for (int p = 0; p < count; ++p)
+            {
+                ruleIndices[start + p] = classifyTrie(ft.trie, ft, msgs[start + p].srcIP, msgs[start + p].destIP);
+            }
+            continue;
+        }
+        else if (mode == HICUTS && ft.tree != NULL)
+        {
+            // the tree returns flow table indices directly
+            for (int p = 0; p < count; ++p)
+            {
+                ruleIndices[start + p] = classifyHiCuts(ft.tree, ft, msgs[start + p].srcIP, msgs[start + p].destIP);
+            }
+            continue;
+        }
+        else if (mode == AVX2)
+        {
+            classifyBatchAVX2(ft, msgs + start, count, bestKeys);
+        }
+        else if (mode == SSE4)
+        {
+            classifyBatchSSE4(ft, msgs + start, count, bestKeys);
+        }
+        else
+        {
+            classifyBatchScalar(ft, msgs + start, count, bestKeys);
+        }
+        for (int p = 0; p < count; ++p)
+        {
+            ruleIndices[start + p] = ruleIndexFromKey(bestKeys[p]);
+        }
+    }
+}
+
+// finds the flow table index of the best rule for a single packet
+int classifyPacket(const flowTableSoA &ft, int srcIP, int destIP, classifyMode mode)
+{
+    queryRelayMessage msg;
+    msg.srcIP = srcIP;
+    msg.destIP = destIP;
+    int ruleIndex;
+    classifyBatch(ft, &msg, 1, &ruleIndex, mode);
+    return ruleIndex;
+}
@@ -0,0 +1,157 @@
+#ifndef FLOWTABLE_H
+#define FLOWTABLE_H
+
+#include "libraries.h"
+#include "packets.h"
+
+// the maximum number of packets drained from a fifo and classified together
+#define CLASSIFY_BATCH 16
+
+// rule index returned when no rule in the flow table matches a packet
+#define NO_RULE -1
+
+// rule index passed along with a packet that has not been classified yet
+#define UNCLASSIFIED -2
+
+/* FLOW TABLE CLASSIFIER
+The switch flow table (connectionInfo) is copied into a structure-of-arrays so the
+range comparisons of many rules can be done at once with SSE4.1/AVX2 compares.
+
+Each rule gets a priority key: a lower pri value wins and, for rules with equal pri,
+the rule added last wins. Picking the best rule is then a max over the keys of the
+matching rules, which is done in-vector.
+
+Since IPs are bounded by MAXIP the switches normally classify with a single index into
+a direct-mapped table (see below). When that table would not fit in DIRECTMAP_BUDGET
+they fall back to a multibit trie. A flow table can also be compiled into a HiCuts
+decision tree (see below) so the cost of a lookup is bounded by the depth of the tree
+rather than the number of rules. The tree is only built by compileFlowTable and is
+dropped when a rule is added, since the switches always classify with the direct-mapped
+table or the trie.
+*/
+struct hicutsTree;
+struct directMap;
+struct multibitTrie;
+
+struct flowTableSoA
+{
+    vector<int> srcIPLo;
+    vector<int> srcIPHi;
+    vector<int> destIPLo;
+    vector<int> destIPHi;
+    vector<int> key;    // priority key of each rule, NO_RULE in the padding lanes
+    int numRules;       // number of real rules, the arrays are padded up to a multiple of 8
+    hicutsTree *tree;   // compiled decision tree, NULL unless compileFlowTable was called since the last rule was added
+    directMap *dense;   // direct-mapped table, NULL if it does not fit in DIRECTMAP_BUDGET
+    multibitTrie *trie; // multibit trie, only built when the direct-mapped table does not fit
+};
+
+/* DIRECT-MAPPED TABLE
+Every srcIP in [0, MAXIP] maps to a bucket; all srcIPs in a bucket are covered by exactly
+the same rules. The table holds the best rule for every (bucket, destIP) pair so a lookup
+is two array reads. A new rule splits the buckets at its srcIP edges (copying the row of
+the bucket that was split) and is then painted over the rows it covers.
+
+Packets with an IP outside [0, MAXIP] are classified by the decision tree or the linear scan.
+*/
+struct directMap
+{
+    vector<int> srcBucket; // bucket of every srcIP in [0, MAXIP]
+    vector<int> table;     // numBuckets rows of MAXIP + 1 rule indices, indexed [bucket][destIP]
+    int numBuckets;
+};
+
+/* MULTIBIT TRIE
+A 256-way trie over the 32 bits of destIP. A rule is stored in the highest nodes whose
+destIP range it covers completely, best priority key first, so a lookup visits at most
+five nodes and checks srcIP against the rules stored in each of them.
+*/
+struct trieNode
+{
+    vector<int> rules;  // flow table indices of the rules covering the node's destIP range, best key first
+    int firstChild;     // index of the first of the 256 contiguous children, -1 if there are none
+};
+
+struct multibitTrie
+{
+    vector<trieNode> nodes; // nodes[0] is the root
+};
+
+/* HICUTS DECISION TREE
+Each internal node cuts its (srcIP, destIP) region into numCuts equal slices along one
+dimension. A leaf holds the flow table indices of the rules overlapping its region,
+best priority key first, so a lookup walks down one path and stops at the first match.
+
+New rules are inserted into the leaves they overlap. Leaves that cutting would not shrink
+(at the depth limit, a single (srcIP, destIP) point, or overlapped by every rule in every
+slice) are marked terminal when the tree is built and simply grow. Once any other leaf
+grows past twice the bucket size the tree is degraded but still correct, and a fresh tree
+is built and swapped in place of the old one after the flow table has grown by
+HICUTS_REBUILD_GROWTH since the last build. A rule outside the root region always causes
+a rebuild.
+*/
+struct hicutsNode
+{
+    int dim;            // dimension cut at this node (0 = srcIP, 1 = destIP), -1 for a leaf
+    int lo[2];          // region covered by the node
+    int hi[2];
+    int numCuts;
+    long long cutWidth;
+    int firstChild;     // index of the first child in the node array, the children are contiguous
+    bool terminal;      // leaf: cutting it would not shrink it, so it grows instead of causing a rebuild
+    vector<int> rules;  // leaf: flow table indices of the overlapping rules, best key first
+};
+
+struct hicutsTree
+{
+    vector<hicutsNode> nodes; // nodes[0] is the root
+    int depth;
+    int numRules;       // rules in the flow table when the tree was built
+    bool degraded;      // a leaf that could still be cut has grown past twice the bucket size
+};
+
+// algorithm and instruction set used by the classifier
+enum classifyMode {SCALAR, SSE4, AVX2, HICUTS, DIRECT, TRIE};
+const string CLASSIFYMODENAME[6] = {"SCALAR", "SSE4", "AVX2", "HICUTS", "DIRECT", "TRIE"};
+
+// flow table function declarations
+void buildFlowTableSoA(flowTableSoA &ft, const vector<message> &rules);
+
+void appendFlowTableSoA(flowTableSoA &ft, flowTableEntry rule);
+
+int ruleIndexFromKey(int key);
+
+classifyMode bestClassifyMode();
+
+classifyMode selectClassifyMode(const flowTableSoA &ft);
+
+void compileFlowTable(flowTableSoA &ft);
+
+hicutsTree *buildHiCutsTree(const flowTableSoA &ft);
+
+bool insertHiCutsRule(hicutsTree *tree, const flowTableSoA &ft, int ruleIndex);
+
+void deleteHiCutsTree(hicutsTree *tree);
+
+int classifyHiCuts(const hicutsTree *tree, const flowTableSoA &ft, int srcIP, int destIP);
+
+long long directMapBytes(int numBuckets);
+
+void compileDirectMap(flowTableSoA &ft);
+
+bool insertDirectMapRule(directMap *dense, const flowTableSoA &ft, int ruleIndex);
+
+int classifyDirectMap(const directMap *dense, int srcIP, int destIP);
+
+void compileTrie(flowTableSoA &ft);
+
+void insertTrieRule(multibitTrie *trie, const flowTableSoA &ft, int ruleIndex);
+
+int classifyTrie(const multibitTrie *trie, const flowTableSoA &ft, int srcIP, int destIP);
+
+int classifyPacket(const flowTableSoA &ft, int srcIP, int destIP, classifyMode mode);
+
+void classifyBatch(const flowTableSoA &ft, const queryRelayMessage msgs[], int numPackets, int ruleIndices[], classifyMode mode);
+// end flow table function declarations
+
+#endif
@@ -17,12 +17,16 @@
 #include <iterator>
 #include <stdio.h> // fopen, fdopen, fread, fwrite
 #include <fcntl.h> //open
+#include <errno.h> // EAGAIN, ENXIO
+#include <deque>
 #include <algorithm> // find
 
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <time.h>
+#include <sys/time.h> // gettimeofday
+#include <sys/signalfd.h> // signalfd
 
 using namespace std;
 
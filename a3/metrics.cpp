@@ -0,0 +1,148 @@
+#include "metrics.h"
+#include "constants.h"
+
+#include <sys/un.h>
+
+// empties a histogram
+void initLatencyHistogram(latencyHistogram &hist)
+{
+    for (int i = 0; i < LATENCY_BUCKETS; ++i)
+    {
+        hist.buckets[i] = 0;
+    }
+    hist.count = 0;
+    hist.totalUsec = 0;
+    hist.maxUsec = 0;
+}
+
+// adds a sample to the bucket of its highest set bit
+void recordLatency(latencyHistogram &hist, long long usec)
+{
+    if (usec < 0)
+    {
+        usec = 0;
+    }
+    int bucket = 0;
+    while (bucket < LATENCY_BUCKETS - 1 && (usec >> (bucket + 1)) > 0)
+    {
+        bucket += 1;
+    }
+    hist.buckets[bucket] += 1;
+    hist.count += 1;
+    hist.totalUsec += usec;
+    if (usec > hist.maxUsec)
+    {
+        hist.maxUsec = usec;
+    }
+}
+
+// returns the number of microseconds since start
+long long elapsedMicroseconds(struct timeval start)
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - start.tv_sec) * 1000000LL + (now.tv_usec - start.tv_usec);
+}
+
+// writes a histogram as name.count, name.mean_usec, name.max_usec and one line per non-empty bucket
+// buckets are labelled by their upper bound in microseconds
+void appendHistogram(ostringstream &snapshot, string name, const latencyHistogram &hist)
+{
+    snapshot << name << ".count=" << hist.count << "\n";
+    snapshot << name << ".mean_usec=" << (hist.count > 0 ? hist.totalUsec / hist.count : 0) << "\n";
+    snapshot << name << ".max_usec=" << hist.maxUsec << "\n";
+    for (int i = 0; i < LATENCY_BUCKETS; ++i)
+    {
+        if (hist.buckets[i] > 0)
+        {
+            if (i == LATENCY_BUCKETS - 1)
+            {
+                snapshot << name << ".le_inf=" << hist.buckets[i] << "\n";
+            }
+            else
+            {
+                snapshot << name << ".le_" << (1LL << (i + 1)) << "=" << hist.buckets[i] << "\n";
+            }
+        }
+    }
+}
+
+// returns the path of the metrics socket for a controller or switch name
+string metricsSocketPath(string name)
+{
+    return string(METRICS_SOCKET_DIR) + "/a3sdn-" + name + ".sock";
+}
+
+// creates a non-blocking listening unix socket at path, returns -1 on failure or if another
+// instance is listening on path. A socket file left behind by an earlier run is removed first
+int openMetricsSocket(string path)
+{
+    struct sockaddr_un sun;
+    if (path.size() >= sizeof(sun.sun_path))
+    {
+        cout << "Metrics socket path is too long: " << path << endl;
+        return -1;
+    }
+
+    int fd;
+    if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0)) < 0)
+    {
+        cout << "Unable to create the metrics socket." << endl;
+        return -1;
+    }
+
+    memset((char *) &sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    strcpy(sun.sun_path, path.c_str());
+
+    // a socket file is only removed if nobody is listening on it, so a second instance with the
+    // same name can not take over the metrics of a running one
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe >= 0 && connect(probe, (struct sockaddr *) &sun, sizeof(sun)) == 0)
+    {
+        cout << "Another instance is serving metrics on " << path << endl;
+        close(probe);
+        close(fd);
+        return -1;
+    }
+    if (probe >= 0 && errno == ECONNREFUSED)
+    {
+        // left behind by an instance that is gone
+        unlink(path.c_str());
+    }
+    if (probe >= 0)
+    {
+        close(probe);
+    }
+
+    if (bind(fd, (struct sockaddr *) &sun, sizeof(sun)) < 0)
+    {
+        cout << "Unable to bind the metrics socket " << path << endl;
+        close(fd);
+        return -1;
+    }
+    if (listen(fd, MAX_NSW) < 0)
+    {
+        cout << "Error listening on the metrics socket." << endl;
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// sends the snapshot to every client waiting on the metrics socket and closes their connections
+// a client that does not read its snapshot right away gets whatever fits in the socket buffer
+void serveMetricsClients(int listenfd, string snapshot)
+{
+    int clientfd;
+    while ((clientfd = accept(listenfd, NULL, NULL)) >= 0)
+    {
+        int flags = fcntl(clientfd, F_GETFL);
+        fcntl(clientfd, F_SETFL, flags | O_NONBLOCK);
+        if (write(clientfd, snapshot.c_str(), snapshot.size()) < 0)
+        {
+            cout << "Unable to write the metrics snapshot." << endl;
+        }
+        close(clientfd);
+    }
+}
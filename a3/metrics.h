@@ -0,0 +1,42 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "libraries.h"
+
+// power of two microsecond buckets, the last bucket also holds everything larger
+#define LATENCY_BUCKETS 24
+
+/* METRICS
+Each controller and switch listens on a unix domain socket. A client that connects is
+sent a snapshot of key=value lines (counters, queue depths, flow table size and latency
+histograms) and the connection is closed, so any number of switches can be scraped with
+e.g. "nc -U /tmp/a3sdn-sw1.sock" without signals or parsing the printed output.
+
+Bucket i of a latency histogram counts samples in [2^i, 2^(i+1)) microseconds,
+bucket 0 also counts samples under one microsecond.
+*/
+struct latencyHistogram
+{
+    long long buckets[LATENCY_BUCKETS];
+    long long count;
+    long long totalUsec;
+    long long maxUsec;
+};
+
+// metrics function declarations
+void initLatencyHistogram(latencyHistogram &hist);
+
+void recordLatency(latencyHistogram &hist, long long usec);
+
+long long elapsedMicroseconds(struct timeval start);
+
+void appendHistogram(ostringstream &snapshot, string name, const latencyHistogram &hist);
+
+string metricsSocketPath(string name);
+
+int openMetricsSocket(string path);
+
+void serveMetricsClients(int listenfd, string snapshot);
+// end metrics function declarations
+
+#endif
@@ -16,13 +16,42 @@ void printMessage(openMessage msg)
                         ", port3= " << sw.ipLow << "-" << sw.ipHigh << ")" << endl;
 }
 
+// returns the action of a flowTableEntry as "TYPE:value"
+// ECMP rules list their candidate ports instead of the raw port mask, e.g. "ECMP:1|2"
+string actionString(flowTableEntry ft)
+{
+    stringstream ss;
+    ss << ACTIONNAME[ft.actionType] << ":";
+    if (ft.actionType == ECMP)
+    {
+        bool first = true;
+        for (int port = 0; port < 32; ++port)
+        {
+            if (ft.actionVal & (1 << port))
+            {
+                if (!first)
+                {
+                    ss << "|";
+                }
+                ss << port;
+                first = false;
+            }
+        }
+    }
+    else
+    {
+        ss << ft.actionVal;
+    }
+    return ss.str();
+}
+
 // prints a flowTableEntry type message
 void printMessage(flowTableEntry msg)
 {
     flowTableEntry ft = msg;
     cout <<                 "(srcIP= "    << ft.srcIPLo  << "-" << ft.srcIPHi  <<
                             ", destIP= "   << ft.destIPLo << "-" << ft.destIPHi << 
-                            ", action= "   << ACTIONNAME[ft.actionType] << ":" << ft.actionVal <<
+                            ", action= "   << actionString(ft) <<
                             ", pri= "      << ft.pri <<
                             ", pktCount= " << ft.pktCount << ")" << endl;
 }
@@ -77,7 +106,7 @@ void printPacketMessage(int source, int destination, packet printPacket, bool tr
 
     // print the packet information based on its type
     cout << "(src= " << src << ", dest= " << dest << ") [" << PACKETNAME[printPacket.type] << "]";
-    if (printPacket.type != ACK && printPacket.type != EXIT)
+    if (printPacket.type != ACK && printPacket.type != EXIT && printPacket.type != PAUSE && printPacket.type != RESUME)
     {
         cout << ": " << endl << "      ";
         if (printPacket.type == ADD)
@@ -142,4 +171,39 @@ packet createOMessagePacket(packetType type, int switchNumber, int port1Switch,
     packet outPacket = {.type = type, .msg = msg};
     return outPacket;
 }
-// end create packet functions
\ No newline at end of file
+// end create packet functions
+
+// ecmp functions
+// selects one port out of the ports set in portMask by hashing the (srcIP, destIP) pair
+// the same flow always hashes to the same port so its packets are not reordered
+int ecmpSelectPort(int portMask, int srcIP, int destIP)
+{
+    int numPorts = __builtin_popcount(portMask);
+    if (numPorts == 0)
+    {
+        return 0;
+    }
+
+    // mix the two addresses so that neighbouring flows spread across the ports
+    unsigned int hash = (unsigned int) srcIP * 0x9E3779B1u;
+    hash ^= (unsigned int) destIP + 0x7F4A7C15u + (hash << 6) + (hash >> 2);
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6Bu;
+    hash ^= hash >> 13;
+
+    // pick the n-th set bit of the mask
+    int n = hash % numPorts;
+    for (int port = 0; port < 32; ++port)
+    {
+        if (portMask & (1 << port))
+        {
+            if (n == 0)
+            {
+                return port;
+            }
+            n -= 1;
+        }
+    }
+    return 0;
+}
+// end ecmp functions
\ No newline at end of file
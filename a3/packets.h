@@ -5,23 +5,36 @@
 
 
 // action type values
-enum action {DROP, FORWARD};
-const string ACTIONNAME[2] = {"DROP", "FORWARD"};
+// ECMP rules store a bitmask of equal-cost ports in actionVal (bit p set for port p)
+enum action {DROP, FORWARD, ECMP};
+const string ACTIONNAME[3] = {"DROP", "FORWARD", "ECMP"};
 
 // packet types
-enum packetType {OPEN, ACK, QUERY, ADD, RELAY, ADMIT, RELAYIN, RELAYOUT, QUEUEDQUERY, QUEUEDRELAY, EXIT};
-const string PACKETNAME[11] = {"OPEN", "ACK", "QUERY", "ADDRULE", "RELAY", "ADMIT", "RELAYIN", "RELAYOUT", "QUEUEDQUERY", "QUEUEDRELAY", "EXIT"};
+// PAUSE and RESUME are sent between neighbouring switches for backpressure
+enum packetType {OPEN, ACK, QUERY, ADD, RELAY, ADMIT, RELAYIN, RELAYOUT, QUEUEDQUERY, QUEUEDRELAY, EXIT, PAUSE, RESUME};
+const string PACKETNAME[13] = {"OPEN", "ACK", "QUERY", "ADDRULE", "RELAY", "ADMIT", "RELAYIN", "RELAYOUT", "QUEUEDQUERY", "QUEUEDRELAY", "EXIT", "PAUSE", "RESUME"};
+
+// what a switch does when one of its queues is full
+// BACKPRESSURE asks the upstream switches to pause before the queues fill, then drops like TAILDROP
+enum queuePolicy {TAILDROP, HEADDROP, BACKPRESSURE};
+const string QUEUEPOLICYNAME[3] = {"tail", "head", "backpressure"};
+
+// reasons a switch drops a packet
+enum dropReason {QUEUEFULL, DESTFULL, LINKFULL};
+const string DROPREASONNAME[3] = {"QUEUEFULL", "DESTFULL", "LINKFULL"};
 
 // the packet stats struct used for storing number of sent and received packets for both switch and controller
 struct packetStats
 {
     map<packetType, int> received;
     map<packetType, int> transmitted;
+    map<int, int> portTransmitted; // switches only: packets sent out of each port, used to monitor ECMP skew
+    map<dropReason, int> dropped;  // switches only: packets dropped by a full queue
 };
 
 /* PACKET DECLARATIONS
 Note: 
--ACK packet has no message
+-ACK, EXIT, PAUSE and RESUME packets have no message
 -RELAY, ADMIT, QUERY, QUEUEDQUERY, QUEUEDRELAY are all of type queryRelayMessage
 -ADD packet message is a flowTableEntry
 -OPEN is of type openMessage
@@ -76,6 +89,8 @@ void printMessage(openMessage msg);
 
 void printMessage(flowTableEntry msg);
 
+string actionString(flowTableEntry ft);
+
 void printPacketMessage(int source, int destination, packet printPacket, bool transmitted = false);
 // end print message function declarations
 
@@ -87,5 +102,9 @@ packet createQRMessagePacket(packetType type, int srcIP, int destIP);
 packet createOMessagePacket(packetType type, int switchNumber, int port1Switch, int port2Switch, int ipLow, int ipHigh);
 // end create packet function declarations
 
+// ecmp function declarations
+int ecmpSelectPort(int portMask, int srcIP, int destIP);
+// end ecmp function declarations
+
 
 #endif
\ No newline at end of file
@@ -0,0 +1,139 @@
+#include "pktpool.h"
+
+// threads every slot onto the free list
+void initPacketPool(packetPool &pool)
+{
+    for (int i = 0; i < PACKET_POOL_SIZE; ++i)
+    {
+        pool.slots[i].next = (i + 1 < PACKET_POOL_SIZE) ? i + 1 : NIL;
+        pool.slots[i].prev = NIL;
+    }
+    pool.freeHead = 0;
+    pool.inUse = 0;
+    pool.highWater = 0;
+    pool.exhausted = 0;
+}
+
+// empties a list, the slots it held must already have been freed
+void initPacketList(packetList &list)
+{
+    list.head = NIL;
+    list.tail = NIL;
+    list.size = 0;
+}
+
+// takes a slot off the free list and stores pkt in it, returns NIL if the pool is empty
+int allocateSlot(packetPool &pool, packet pkt)
+{
+    if (pool.freeHead == NIL)
+    {
+        pool.exhausted += 1;
+        return NIL;
+    }
+    int slot = pool.freeHead;
+    pool.freeHead = pool.slots[slot].next;
+    pool.slots[slot].pkt = pkt;
+    pool.inUse += 1;
+    if (pool.inUse > pool.highWater)
+    {
+        pool.highWater = pool.inUse;
+    }
+    return slot;
+}
+
+// returns a slot to the free list, the slot must not be on any other list
+void freeSlot(packetPool &pool, int slot)
+{
+    pool.slots[slot].next = pool.freeHead;
+    pool.slots[slot].prev = NIL;
+    pool.freeHead = slot;
+    pool.inUse -= 1;
+}
+
+// links a slot onto the end of a list
+void appendSlot(packetPool &pool, packetList &list, int slot)
+{
+    pool.slots[slot].next = NIL;
+    pool.slots[slot].prev = list.tail;
+    if (list.tail == NIL)
+    {
+        list.head = slot;
+    }
+    else
+    {
+        pool.slots[list.tail].next = slot;
+    }
+    list.tail = slot;
+    list.size += 1;
+}
+
+// unlinks a slot from a list without freeing it
+void eraseSlot(packetPool &pool, packetList &list, int slot)
+{
+    int prev = pool.slots[slot].prev;
+    int next = pool.slots[slot].next;
+    if (prev == NIL)
+    {
+        list.head = next;
+    }
+    else
+    {
+        pool.slots[prev].next = next;
+    }
+    if (next == NIL)
+    {
+        list.tail = prev;
+    }
+    else
+    {
+        pool.slots[next].prev = prev;
+    }
+    list.size -= 1;
+}
+
+// queues a packet at the end of a list, returns false if the pool is empty
+bool pushBackPacket(packetPool &pool, packetList &list, packet pkt)
+{
+    int slot = allocateSlot(pool, pkt);
+    if (slot == NIL)
+    {
+        return false;
+    }
+    appendSlot(pool, list, slot);
+    return true;
+}
+
+// queues a packet at the front of a list, returns false if the pool is empty
+bool pushFrontPacket(packetPool &pool, packetList &list, packet pkt)
+{
+    int slot = allocateSlot(pool, pkt);
+    if (slot == NIL)
+    {
+        return false;
+    }
+    pool.slots[slot].prev = NIL;
+    pool.slots[slot].next = list.head;
+    if (list.head == NIL)
+    {
+        list.tail = slot;
+    }
+    else
+    {
+        pool.slots[list.head].prev = slot;
+    }
+    list.head = slot;
+    list.size += 1;
+    return true;
+}
+
+// unlinks the first slot of a list and returns it without freeing it, NIL if the list is empty
+// the caller either frees the slot or appends it to a list again
+int popFrontSlot(packetPool &pool, packetList &list)
+{
+    int slot = list.head;
+    if (slot != NIL)
+    {
+        eraseSlot(pool, list, slot);
+    }
+    return slot;
+}
@@ -0,0 +1,59 @@
+#ifndef PKTPOOL_H
+#define PKTPOOL_H
+
+#include "packets.h"
+#include "constants.h"
+
+// one slot for every packet the switch queues can hold, plus room for PAUSE/RESUME packets
+#define PACKET_POOL_SIZE (MAX_QUEUED_PACKETS + MAX_NSW * MAX_LINK_QUEUE + 2 * MAX_NSW)
+
+// index of the end of a list
+#define NIL -1
+
+/* PACKET POOL
+Every queued packet lives in a fixed array of slots allocated once when the program starts.
+The waiting queue and the link queues are intrusive doubly linked lists threaded through the
+slots by index, so queueing, requeueing and dropping a packet never allocate.
+*/
+struct poolSlot
+{
+    packet pkt;
+    int next;   // next slot in the list holding this slot, or in the free list
+    int prev;
+};
+
+struct packetList
+{
+    int head;
+    int tail;
+    int size;
+};
+
+struct packetPool
+{
+    poolSlot slots[PACKET_POOL_SIZE];
+    int freeHead;   // first unused slot
+    int inUse;      // number of slots holding a queued packet
+    int highWater;  // most slots in use at once
+    int exhausted;  // number of packets refused because every slot was in use
+};
+
+// packet pool function declarations
+void initPacketPool(packetPool &pool);
+
+void initPacketList(packetList &list);
+
+bool pushBackPacket(packetPool &pool, packetList &list, packet pkt);
+
+bool pushFrontPacket(packetPool &pool, packetList &list, packet pkt);
+
+int popFrontSlot(packetPool &pool, packetList &list);
+
+void appendSlot(packetPool &pool, packetList &list, int slot);
+
+void eraseSlot(packetPool &pool, packetList &list, int slot);
+
+void freeSlot(packetPool &pool, int slot);
+// end packet pool function declarations
+
+#endif
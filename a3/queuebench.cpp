@@ -0,0 +1,192 @@
+/*
+Allocation check for the a3sdn switch queues.
+
+Pushes overload traffic through the queue of packets waiting for a rule and the link queues
+under each queue policy: packets are dropped at the queue bounds, returned to the queue while
+no rule matches, delivered, and held for a paused neighbour behind PAUSE packets. Every
+operator new is counted and the check fails if the steady state allocates at all.
+
+usage: queuebench [numRounds]
+*/
+
+#include "libraries.h"
+#include "constants.h"
+#include "packets.h"
+#include "pktpool.h"
+#include "swqueue.h"
+#include "metrics.h"
+
+#include <fstream>
+#include <new>
+
+// number of operator new calls made so far
+long long allocations = 0;
+
+void *operator new(size_t size)
+{
+    allocations += 1;
+    void *p = malloc(size == 0 ? 1 : size);
+    if (p == NULL)
+    {
+        throw bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+packetPool pool;
+packetList waitingQueue;
+packetList linkQueues[MAX_NSW + 1];
+queryTable sentQueries;
+packetStats stats;
+latencyHistogram queryLatency;
+
+// returns the current time in seconds
+double currentTime()
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return now.tv_sec + now.tv_usec / 1000000.0;
+}
+
+// one round of overload traffic, returns the number of packets pushed through the queues
+int runRound(queuePolicy policy)
+{
+    int numPackets = 0;
+
+    // more packets arrive than the queue holds, a query is sent for each new destination
+    for (int i = 0; i < 4 * MAX_QUEUED_PACKETS; ++i)
+    {
+        packet inPacket = createQRMessagePacket(QUEUEDRELAY, rand() % (2 * MAXIP), rand() % 8);
+        enqueueWaitingPacket(pool, waitingQueue, inPacket, policy, stats.dropped);
+        markQuerySent(sentQueries, inPacket.msg.qrMessage);
+        numPackets += 1;
+    }
+
+    // no rule matches yet, every packet is returned to the queue as processPacketQueue does
+    int count = waitingQueue.size;
+    for (int i = 0; i < count; ++i)
+    {
+        int slot = popFrontSlot(pool, waitingQueue);
+        packet inPacket = pool.slots[slot].pkt;
+        freeSlot(pool, slot);
+        pushBackPacket(pool, waitingQueue, inPacket);
+    }
+
+    // a rule answers half of the destinations, their packets are delivered
+    flowTableEntry rule = createAMessagePacket(ADD, 0, MAXIP, 0, 3, FORWARD, 1, MINPRI, 0).msg.aMessage;
+    recordAnsweredQueries(sentQueries, rule, queryLatency);
+    count = waitingQueue.size;
+    for (int i = 0; i < count; ++i)
+    {
+        int slot = popFrontSlot(pool, waitingQueue);
+        packet inPacket = pool.slots[slot].pkt;
+        freeSlot(pool, slot);
+        if (inPacket.msg.qrMessage.destIP <= rule.destIPHi)
+        {
+            clearQuerySent(sentQueries, inPacket.msg.qrMessage);
+        }
+        else
+        {
+            pushBackPacket(pool, waitingQueue, inPacket);
+        }
+    }
+
+    // a paused neighbour, its link queue overflows behind the control packets
+    for (int receiver = 1; receiver <= MAX_NSW; ++receiver)
+    {
+        packet pausePacket;
+        pausePacket.type = PAUSE;
+        pushFrontPacket(pool, linkQueues[receiver], pausePacket);
+        for (int i = 0; i < 2 * MAX_LINK_QUEUE; ++i)
+        {
+            packet outPacket = createQRMessagePacket(RELAY, rand() % (MAXIP + 1), rand() % (MAXIP + 1));
+            enqueueLinkPacket(pool, linkQueues[receiver], receiver, outPacket, policy, stats.dropped);
+            numPackets += 1;
+        }
+    }
+
+    // the neighbours resume and every queue drains
+    for (int receiver = 1; receiver <= MAX_NSW; ++receiver)
+    {
+        while (linkQueues[receiver].head != NIL)
+        {
+            freeSlot(pool, popFrontSlot(pool, linkQueues[receiver]));
+        }
+    }
+    while (waitingQueue.head != NIL)
+    {
+        packet inPacket = pool.slots[waitingQueue.head].pkt;
+        freeSlot(pool, popFrontSlot(pool, waitingQueue));
+        clearQuerySent(sentQueries, inPacket.msg.qrMessage);
+    }
+    return numPackets;
+}
+
+int main(int argc, char *argv[])
+{
+    int numRounds = 2000;
+    if (argc == 2)
+    {
+        numRounds = atoi(argv[1]);
+    }
+    srand(379);
+
+    initPacketPool(pool);
+    initPacketList(waitingQueue);
+    for (int i = 0; i <= MAX_NSW; ++i)
+    {
+        initPacketList(linkQueues[i]);
+    }
+    initQueryTable(sentQueries);
+    initLatencyHistogram(queryLatency);
+
+    // the drop counters are the only maps the queues touch, a switch allocates their nodes on the first drop
+    stats.dropped[QUEUEFULL] = 0;
+    stats.dropped[DESTFULL] = 0;
+    stats.dropped[LINKFULL] = 0;
+
+    // the queues print every drop, send it to /dev/null so only the queues themselves are measured
+    ofstream devNull("/dev/null");
+    streambuf *console = cout.rdbuf(devNull.rdbuf());
+
+    printf("policy    rounds     packets/sec    allocations\n");
+    bool failed = false;
+    const queuePolicy POLICIES[2] = {TAILDROP, HEADDROP};
+    for (int p = 0; p < 2; ++p)
+    {
+        // a warm up round, the output stream sets up its buffers on the first writes
+        runRound(POLICIES[p]);
+
+        long long startAllocations = allocations;
+        long long numPackets = 0;
+        double start = currentTime();
+        for (int round = 0; round < numRounds; ++round)
+        {
+            numPackets += runRound(POLICIES[p]);
+        }
+        double elapsed = currentTime() - start;
+        long long numAllocations = allocations - startAllocations;
+
+        printf("%-9s %-9d %12.0f %14lld\n", QUEUEPOLICYNAME[POLICIES[p]].c_str(), numRounds, numPackets / elapsed, numAllocations);
+        if (numAllocations != 0)
+        {
+            printf("ERROR: the %s policy allocated while queueing packets\n", QUEUEPOLICYNAME[POLICIES[p]].c_str());
+            failed = true;
+        }
+        if (pool.inUse != 0)
+        {
+            printf("ERROR: the %s policy leaked %d pool slots\n", QUEUEPOLICYNAME[POLICIES[p]].c_str(), pool.inUse);
+            failed = true;
+        }
+    }
+    printf("pool high water= %d/%d, exhausted= %d, sent queries= %d, drops: QUEUEFULL= %d, DESTFULL= %d, LINKFULL= %d\n", pool.highWater, PACKET_POOL_SIZE,
+           pool.exhausted, sentQueries.numSent, stats.dropped[QUEUEFULL], stats.dropped[DESTFULL], stats.dropped[LINKFULL]);
+
+    cout.rdbuf(console);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,175 @@
+#include "swqueue.h"
+
+// returns the number of packets in the queue waiting for a rule to destIP
+// the queue is bounded by MAX_QUEUED_PACKETS so walking it is cheap
+int queuedForDest(packetPool &pool, packetList &queue, int destIP)
+{
+    int count = 0;
+    for (int slot = queue.head; slot != NIL; slot = pool.slots[slot].next)
+    {
+        if (pool.slots[slot].pkt.msg.qrMessage.destIP == destIP)
+        {
+            count += 1;
+        }
+    }
+    return count;
+}
+
+// switch adds a packet that is waiting for a rule to the queue
+// the queue is bounded in total and per destIP, the queue policy decides which packet is dropped when full
+// returns false if the arriving packet was dropped
+bool enqueueWaitingPacket(packetPool &pool, packetList &queue, packet inPacket, queuePolicy policy, map<dropReason, int> &dropped)
+{
+    int destIP = inPacket.msg.qrMessage.destIP;
+    bool full = true;
+    dropReason reason;
+    if (queuedForDest(pool, queue, destIP) >= MAX_QUEUED_PER_DEST)
+    {
+        reason = DESTFULL;
+    }
+    else if (queue.size >= MAX_QUEUED_PACKETS)
+    {
+        reason = QUEUEFULL;
+    }
+    else
+    {
+        full = false;
+    }
+
+    if (full)
+    {
+        dropped[reason] += 1;
+        if (policy != HEADDROP)
+        {
+            cout << "Queue is full (" << DROPREASONNAME[reason] << "). Packet dropped." << endl;
+            return false;
+        }
+        // drop the oldest waiting packet, for the same destination if that is the bound that was hit
+        for (int slot = queue.head; slot != NIL; slot = pool.slots[slot].next)
+        {
+            queryRelayMessage &queued = pool.slots[slot].pkt.msg.qrMessage;
+            if (reason == QUEUEFULL || queued.destIP == destIP)
+            {
+                cout << "Queue is full (" << DROPREASONNAME[reason] << "). Oldest packet dropped: ";
+                printMessage(queued);
+                eraseSlot(pool, queue, slot);
+                freeSlot(pool, slot);
+                break;
+            }
+        }
+    }
+    if (!pushBackPacket(pool, queue, inPacket))
+    {
+        cout << "Packet pool is exhausted. Packet dropped." << endl;
+        return false;
+    }
+    return true;
+}
+
+// switch holds a packet for a neighbour whose fifo is full or who has asked for a pause
+// returns false if the packet was dropped
+bool enqueueLinkPacket(packetPool &pool, packetList &linkQueue, int receiver, packet outPacket, queuePolicy policy, map<dropReason, int> &dropped)
+{
+    if (linkQueue.size >= MAX_LINK_QUEUE)
+    {
+        dropped[LINKFULL] += 1;
+        if (policy != HEADDROP)
+        {
+            cout << "Link queue to sw" << receiver << " is full. Packet dropped." << endl;
+            return false;
+        }
+        // drop the oldest packet that is not a PAUSE or RESUME to make room
+        for (int slot = linkQueue.head; slot != NIL; slot = pool.slots[slot].next)
+        {
+            packetType type = pool.slots[slot].pkt.type;
+            if (type != PAUSE && type != RESUME)
+            {
+                eraseSlot(pool, linkQueue, slot);
+                freeSlot(pool, slot);
+                break;
+            }
+        }
+        cout << "Link queue to sw" << receiver << " is full. Oldest packet dropped." << endl;
+    }
+    if (!pushBackPacket(pool, linkQueue, outPacket))
+    {
+        cout << "Packet pool is exhausted. Packet dropped." << endl;
+        return false;
+    }
+    cout << "Packet held for sw" << receiver << ". Number of packets in link queue: " << linkQueue.size << endl;
+    return true;
+}
+
+// empties the table of sent queries
+void initQueryTable(queryTable &queries)
+{
+    for (int i = 0; i < 2; ++i)
+    {
+        for (int destIP = 0; destIP <= MAXIP; ++destIP)
+        {
+            queries.entries[i][destIP].sent = false;
+            queries.entries[i][destIP].timed = false;
+        }
+    }
+    queries.numSent = 0;
+}
+
+// returns the entry of the query for a packet, NULL if its destIP is outside [0, MAXIP]
+sentQuery *findSentQuery(queryTable &queries, queryRelayMessage qrMessage)
+{
+    if (qrMessage.destIP < 0 || qrMessage.destIP > MAXIP)
+    {
+        return NULL;
+    }
+    return &queries.entries[qrMessage.srcIP <= MAXIP][qrMessage.destIP];
+}
+
+// records that a query is being sent for a packet
+// returns false if a matching query was already sent, so no other one is needed
+bool markQuerySent(queryTable &queries, queryRelayMessage qrMessage)
+{
+    sentQuery *entry = findSentQuery(queries, qrMessage);
+    if (entry == NULL)
+    {
+        return true;
+    }
+    if (entry->sent)
+    {
+        return false;
+    }
+    entry->sent = true;
+    entry->timed = true;
+    gettimeofday(&entry->sentTime, NULL);
+    queries.numSent += 1;
+    return true;
+}
+
+// a packet waiting for the query was delivered, the next packet to miss sends a new query
+void clearQuerySent(queryTable &queries, queryRelayMessage qrMessage)
+{
+    sentQuery *entry = findSentQuery(queries, qrMessage);
+    if (entry != NULL && entry->sent)
+    {
+        entry->sent = false;
+        queries.numSent -= 1;
+    }
+}
+
+// records the latency of every timed query answered by a new rule
+void recordAnsweredQueries(queryTable &queries, flowTableEntry rule, latencyHistogram &hist)
+{
+    int lo = max(rule.destIPLo, 0);
+    int hi = min(rule.destIPHi, MAXIP);
+    for (int i = 0; i < 2; ++i)
+    {
+        for (int destIP = lo; destIP <= hi; ++destIP)
+        {
+            sentQuery &entry = queries.entries[i][destIP];
+            if (entry.timed)
+            {
+                recordLatency(hist, elapsedMicroseconds(entry.sentTime));
+                entry.timed = false;
+            }
+        }
+    }
+}
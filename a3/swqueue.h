@@ -0,0 +1,49 @@
+#ifndef SWQUEUE_H
+#define SWQUEUE_H
+
+#include "libraries.h"
+#include "constants.h"
+#include "packets.h"
+#include "pktpool.h"
+#include "metrics.h"
+
+/* SWITCH QUEUES
+A switch holds the packets waiting for a rule in one queue and the packets waiting for a
+neighbour's fifo in a link queue per neighbour, all in the slots of its packet pool. The queue
+policy decides which packet is dropped when a queue is full.
+
+The queries a switch has sent are kept in a fixed table indexed by (srcIP <= MAXIP, destIP) so
+a second packet for the same destination does not send a duplicate query. An entry stays sent
+until a queued packet for it is delivered and timed until a rule answering it is added. Packets
+with a destIP outside [0, MAXIP] have no entry and always send their query.
+*/
+struct sentQuery
+{
+    bool sent;                  // a query was sent and no packet waiting for it has been delivered yet
+    bool timed;                 // no rule answering the query has been added yet
+    struct timeval sentTime;
+};
+
+struct queryTable
+{
+    sentQuery entries[2][MAXIP + 1];
+    int numSent;                // number of entries that are sent
+};
+
+// switch queue function declarations
+int queuedForDest(packetPool &pool, packetList &queue, int destIP);
+
+bool enqueueWaitingPacket(packetPool &pool, packetList &queue, packet inPacket, queuePolicy policy, map<dropReason, int> &dropped);
+
+bool enqueueLinkPacket(packetPool &pool, packetList &linkQueue, int receiver, packet outPacket, queuePolicy policy, map<dropReason, int> &dropped);
+
+void initQueryTable(queryTable &queries);
+
+bool markQuerySent(queryTable &queries, queryRelayMessage qrMessage);
+
+void clearQuerySent(queryTable &queries, queryRelayMessage qrMessage);
+
+void recordAnsweredQueries(queryTable &queries, flowTableEntry rule, latencyHistogram &hist);
+// end switch queue function declarations
+
+#endif
@@ -0,0 +1,190 @@
+/*
+Workload generator for a4tasks.
+
+Writes a resources line and one task line per task to stdout. Every task needs a few
+resource types picked at random, and each resource gets as many units as the contention
+ratio allows: with ratio c the tasks together ask for c times the units that exist, so a
+ratio of 1 or less means every task can hold its resources at once.
+
+usage: a4gen [-t tasks] [-r resources] [-k needsPerTask] [-n maxUnitsPerNeed] [-c contention]
+             [-b busy] [-i idle] [-s seed]
+
+-t  number of tasks (default 20)
+-r  number of resource types, at most 10 (default 4)
+-k  resource types each task needs, at most -r (default 2)
+-n  a need is for 1 to this many units (default 3)
+-c  units asked for by all tasks / units that exist, for each resource (default 2)
+-b  busy time distribution in msec (default uniform:5-20)
+-i  idle time distribution in msec (default uniform:5-20)
+    distributions: fixed:N, uniform:LO-HI, exp:MEAN
+-s  random seed (default 379)
+*/
+
+#include "libraries.h"
+#include "resources.h"
+
+#include <random>
+#include <algorithm>
+#include <math.h>
+
+enum distributionKind {FIXED, UNIFORM, EXPONENTIAL};
+
+// how busy or idle times are drawn
+struct timeDistribution
+{
+    distributionKind kind;
+    int lo;     // fixed: the time, uniform: the smallest time, exp: the mean
+    int hi;     // uniform: the largest time
+};
+
+mt19937 generator;
+
+// parses fixed:N, uniform:LO-HI or exp:MEAN, returns false if text is none of them
+bool parseDistribution(string text, timeDistribution &dist)
+{
+    int colonIndex = text.find(":");
+    if (colonIndex == string::npos)
+    {
+        return false;
+    }
+    string kind = text.substr(0, colonIndex);
+    string args = text.substr(colonIndex + 1);
+    if (kind.compare("fixed") == 0)
+    {
+        dist.kind = FIXED;
+        dist.lo = atoi(args.c_str());
+        dist.hi = dist.lo;
+    }
+    else if (kind.compare("uniform") == 0 && args.find("-") != string::npos)
+    {
+        dist.kind = UNIFORM;
+        dist.lo = atoi(args.substr(0, args.find("-")).c_str());
+        dist.hi = atoi(args.substr(args.find("-") + 1).c_str());
+    }
+    else if (kind.compare("exp") == 0)
+    {
+        dist.kind = EXPONENTIAL;
+        dist.lo = atoi(args.c_str());
+        dist.hi = dist.lo;
+    }
+    else
+    {
+        return false;
+    }
+    return dist.lo >= 0 && dist.hi >= dist.lo;
+}
+
+// draws a time in msec from a distribution
+int drawTime(const timeDistribution &dist)
+{
+    if (dist.kind == UNIFORM)
+    {
+        return uniform_int_distribution<int>(dist.lo, dist.hi)(generator);
+    }
+    if (dist.kind == EXPONENTIAL && dist.lo > 0)
+    {
+        return (int) lround(exponential_distribution<double>(1.0 / dist.lo)(generator));
+    }
+    return dist.lo;
+}
+
+int main(int argc, char *argv[])
+{
+    int numTasks = 20;
+    int numResources = 4;
+    int needsPerTask = 2;
+    int maxUnits = 3;
+    double contention = 2;
+    timeDistribution busy = {UNIFORM, 5, 20};
+    timeDistribution idle = {UNIFORM, 5, 20};
+    unsigned int seed = 379;
+
+    int opt;
+    bool valid = true;
+    while ((opt = getopt(argc, argv, "t:r:k:n:c:b:i:s:")) != -1)
+    {
+        switch (opt)
+        {
+            case 't':
+                numTasks = atoi(optarg);
+                break;
+            case 'r':
+                numResources = atoi(optarg);
+                break;
+            case 'k':
+                needsPerTask = atoi(optarg);
+                break;
+            case 'n':
+                maxUnits = atoi(optarg);
+                break;
+            case 'c':
+                contention = atof(optarg);
+                break;
+            case 'b':
+                valid = valid && parseDistribution(optarg, busy);
+                break;
+            case 'i':
+                valid = valid && parseDistribution(optarg, idle);
+                break;
+            case 's':
+                seed = atoi(optarg);
+                break;
+            default:
+                valid = false;
+                break;
+        }
+    }
+    if (!valid || optind != argc || numTasks < 0 || numResources < 1 || numResources > NRES_TYPES ||
+        needsPerTask < 0 || needsPerTask > numResources || maxUnits < 1 || contention <= 0)
+    {
+        cerr << "usage: a4gen [-t tasks] [-r resources] [-k needsPerTask] [-n maxUnitsPerNeed] [-c contention] "
+                "[-b busy] [-i idle] [-s seed]" << endl;
+        return 1;
+    }
+    generator.seed(seed);
+
+    // pick the needs of every task first, the units of each resource depend on them
+    vector<vector<pair<int, int> > > needs(numTasks);
+    vector<long long> demand(numResources, 0);
+    vector<int> largestNeed(numResources, 0);
+    vector<int> ids(numResources);
+    for (int id = 0; id < numResources; ++id)
+    {
+        ids[id] = id;
+    }
+    for (int t = 0; t < numTasks; ++t)
+    {
+        shuffle(ids.begin(), ids.end(), generator);
+        vector<int> picked(ids.begin(), ids.begin() + needsPerTask);
+        sort(picked.begin(), picked.end());
+        for (int i = 0; i < picked.size(); ++i)
+        {
+            int units = uniform_int_distribution<int>(1, maxUnits)(generator);
+            needs[t].push_back(make_pair(picked[i], units));
+            demand[picked[i]] += units;
+            largestNeed[picked[i]] = max(largestNeed[picked[i]], units);
+        }
+    }
+
+    // every task must be able to run on its own however high the contention
+    cout << "# a4gen -t " << numTasks << " -r " << numResources << " -k " << needsPerTask << " -n " << maxUnits <<
+            " -c " << contention << " -s " << seed << endl;
+    cout << "resources";
+    for (int id = 0; id < numResources; ++id)
+    {
+        long long units = max((long long) largestNeed[id], (long long) ceil(demand[id] / contention));
+        cout << " R" << id << ":" << max(1LL, units);
+    }
+    cout << endl;
+
+    for (int t = 0; t < numTasks; ++t)
+    {
+        cout << "task t" << t << " " << drawTime(busy) << " " << drawTime(idle);
+        for (int i = 0; i < needs[t].size(); ++i)
+        {
+            cout << " R" << needs[t][i].first << ":" << needs[t][i].second;
+        }
+        cout << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,78 @@
+/*
+Resource manager daemon: serves the resources declared in an a4tasks input file to tasks in
+other processes over a unix socket, see manager.h. The task lines are checked but not run.
+Runs until SIGINT or SIGTERM and then prints what it served.
+
+usage: a4rmd [-s firstfit|fifo|sbtf|priority|lottery] [-l leaseMsec] socketPath inputFile
+
+-s  which waiting request released resources are granted to, see scheduler.h (default fifo)
+-l  msec a client may hold a grant without renewing it before it is taken back (default 10000)
+*/
+
+#include "libraries.h"
+#include "resources.h"
+#include "manager.h"
+#include "parser.h"
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    schedulePolicy policy = FIFO;
+    int leaseMsec = MANAGER_LEASE_MSEC;
+    while ((opt = getopt(argc, argv, "s:l:")) != -1)
+    {
+        if (opt == 's' && policyFromName(optarg) >= 0)
+        {
+            policy = (schedulePolicy) policyFromName(optarg);
+        }
+        else if (opt == 'l' && atoi(optarg) > 0)
+        {
+            leaseMsec = atoi(optarg);
+        }
+        else
+        {
+            cout << "usage: a4rmd [-s firstfit|fifo|sbtf|priority|lottery] [-l leaseMsec] socketPath inputFile" << endl;
+            return 1;
+        }
+    }
+    if (argc - optind != 2)
+    {
+        cout << "usage: a4rmd [-s firstfit|fifo|sbtf|priority|lottery] [-l leaseMsec] socketPath inputFile" << endl;
+        return 1;
+    }
+    string socketPath = argv[optind];
+    string inputFile = argv[optind + 1];
+
+    inputSpec input;
+    string error;
+    if (!parseInput(inputFile, input, error))
+    {
+        cout << "ERROR: " << error << endl;
+        return 1;
+    }
+    initResourcePool(QUEUE, policy);
+    for (int id = 0; id < input.resourceNames.size(); ++id)
+    {
+        addResource(input.resourceNames[id], input.resourceUnits[id]);
+    }
+    int listenfd = openManagerSocket(socketPath);
+    if (listenfd < 0)
+    {
+        cout << "Unable to listen on " << socketPath << endl;
+        return 1;
+    }
+    cout << "Serving " << resourceNames.size() << " resources on " << socketPath << " (policy= " <<
+            POLICYNAME[policy] << ", lease= " << leaseMsec << " msec)" << endl;
+
+    bool served = runManager(listenfd, leaseMsec);
+    close(listenfd);
+    unlink(socketPath.c_str());
+    if (!served)
+    {
+        cout << "Unable to start the event loop." << endl;
+        return 1;
+    }
+    cout << "Clients= " << managerClients << ", grants= " << managerGrants << ", expired leases= " << managerExpired <<
+            ", disconnects= " << managerDisconnects << endl;
+    return 0;
+}
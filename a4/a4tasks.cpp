@@ -1,230 +1,363 @@
-#include "libraries.h"
+/*
+usage: a4tasks [-m poll|queue|atomic|incremental] [-s firstfit|fifo|sbtf|priority|lottery] [-x workers] [-v] [-c]
+               [-w sleep|spin|compute|mem|shared] [-o metricsFile] [-t starvationMsec] [-T traceFile]
+               [-u socketPath] inputFile monitorTime NITER
+
+-m  how a task waits for resources that are not available
+    poll:   retry every 10 msec
+    queue:  block on a condition variable until released resources are granted to it (default)
+    atomic: reserve with CAS on per-resource counters and sleep on a futex, no global lock
+    incremental: queue, but take each unit as soon as it is available and roll back deadlocked
+                 tasks, see resources.h
+-s  which waiting task released resources are granted to in queue mode, see scheduler.h
+    (default firstfit)
+-x  run the tasks on a pool of this many worker threads instead of a thread per task,
+    removes the limit of NTASKS tasks (not atomic)
+-v  simulate in virtual time: busy, idle and poll periods take no wall time and the monitor
+    and all reported times are in simulated msec, runs are deterministic (not atomic)
+-c  run each task as a coroutine on the executor, on one worker unless -x is given (not
+    atomic)
+-w  what a task does for its busy time, anything but sleep uses the CPU for it, see work.h
+    (default sleep, not with -v)
+-o  append a metrics sample to this file every monitorTime msec, one JSON object per line if
+    the name ends in .json and CSV otherwise, see metrics.h
+-t  a wait for resources longer than this is counted as a starvation event (default 1000)
+-T  record every state change and grant and write them to this file as a Chrome trace at exit,
+    see trace.h
+-u  get the resources from the a4rmd listening on this socket, shared with the tasks of other
+    processes, instead of from a pool of this process (thread per task only, the resource
+    utilization is then only reported by a4rmd's clients together), see manager.h
+*/
 
-#define NRES_TYPES 10
-#define NTASKS 25
-#define MAXLINE 32
+#include "libraries.h"
+#include "locks.h"
+#include "resources.h"
+#include "executor.h"
+#include "output.h"
+#include "metrics.h"
+#include "coroutines.h"
+#include "work.h"
+#include "trace.h"
+#include "manager.h"
+#include "parser.h"
+
+#define NTASKS 25 // most tasks when each task has its own thread
+#define SNAPSHOT_RETRIES 100 // times the monitor retries a snapshot that a state change overlapped
 
 using namespace std;
 
 enum state {WAIT, RUN, IDLE};
 const string STATENAME[3] = {"WAIT", "RUN", "IDLE"};
 
-struct rsrc 
+// a task state the monitor can read while the task changes it
+// the value counts the changes as well, changes * 3 + state, so the monitor can tell a task that
+// changed state and back from one that did not change
+struct atomicState
 {
-    string name;
-    int total;
-    int held;
+    atomic<long long> value;
+    atomicState() : value(WAIT) {}
+    atomicState(const atomicState &other) : value(other.value.load()) {}
+    state get() const { return (state) (value.load() % 3); }
 };
 
+// executor: the next step of a task, see stepTask
+enum taskPhase {START_ITERATION, ACQUIRE, GRANTED, BUSY_DONE, IDLE_DONE};
+
 struct taskParameters
 {
     string name;
-    state taskState;
+    atomicState taskState;          // changed only through setTaskState
     int busyTime;
     int idleTime;
     pthread_t ntid;
-    vector<rsrc> taskResources;
+    resourceRequest request;
     int numberIterations;
     int waitTime;
+    int starved;                    // iterations that waited longer than the starvation threshold
+    taskPhase phase;                // executor: what to do when the task next runs
+    long long startWaitTime;        // executor: when the task started waiting for resources, in usec
 };
 
-taskParameters taskList[NTASKS]; 
-map<string, int> resources;
+vector<taskParameters> taskList;
+waitMode taskWaitMode = QUEUE;
+schedulePolicy taskPolicy = FIRSTFIT;
+int executorWorkers = 0;            // 0 runs each task on its own thread
+bool virtualTime = false;           // run the tasks on the executor against a virtual clock
+workMode taskWorkMode = SLEEP;
+bool coroutineTasks = false;        // run the tasks as coroutines on the executor instead of stepTask
+vector<taskCoroutine> coroutines;   // coroutines: the coroutine of each task
+string managerPath;                 // socket of the resource manager the tasks use, empty for none
 
 int NITER;
 int numTasks = 0;
 struct timeval startTime;
-pthread_mutex_t resourceMutex;
-pthread_rwlock_t monitorLock;
-
-// -------------------------------------------
-// mutex functions borrowed from "Experiments involving race conditions in multithreaded programs"
-// located on the course website
-// all mutex-like functions used are similar to these
-void mutex_init(pthread_mutex_t* mutex)
-{
-    int rval= pthread_mutex_init(mutex, NULL);
-    if (rval) {perror("Problem initializing mutex"); exit(1); }
-}    
 
-void mutex_lock(pthread_mutex_t* mutex)
-{
-    int rval= pthread_mutex_lock(mutex);
-    if (rval) {perror("Lock error for mutex"); exit(1); }
-}    
-
-void mutex_unlock(pthread_mutex_t* mutex)
-{
-    int rval= pthread_mutex_unlock(mutex);
-    if (rval) {perror("Unlock error for mutex"); exit(1); }
-}
-// -------------------------------------------
-
-// -------------------------------------------
-// read-write lock functions
-void rwlock_init(pthread_rwlock_t* rwlock)
-{
-    int rval = pthread_rwlock_init(rwlock, NULL);
-    if (rval) {perror("Problem initializing rwlock"); exit(1); }
-}
-
-void rwlock_rdlock(pthread_rwlock_t* rwlock)
-{
-    int rval = pthread_rwlock_rdlock(rwlock);
-    if (rval) {perror("Read lock error for rwlock"); exit(1); }
-}
-
-void rwlock_wrlock(pthread_rwlock_t* rwlock)
+// enables or disables the cancel response for the monitor
+void setCancelState(int state) 
 {
-    int rval = pthread_rwlock_wrlock(rwlock);
-    if (rval) {perror("Write lock error for rwlock"); exit(1); }
+    int rval= pthread_setcancelstate(state, NULL);
+    if (rval) {perror("Monitor cancel state change error"); exit(1); }
 }
 
-void rwlock_unlock(pthread_rwlock_t* rwlock)
+// changes the state of a task without blocking the monitor or being blocked by it
+// only the task itself changes its state, so it touches nothing shared with the other tasks
+void setTaskState(int taskIndex, state newState)
 {
-    int rval = pthread_rwlock_unlock(rwlock);
-    if (rval) {perror("Unlock error for rwlock"); exit(1); }
+    atomic<long long> &value = taskList[taskIndex].taskState.value;
+    long long old = value.load(memory_order_relaxed);
+    state oldState = (state) (old % 3);
+    value.store(old - oldState + 3 + newState);
+    if ((oldState == WAIT) != (newState == WAIT))
+    {
+        recordWaitingChange(taskIndex, newState == WAIT);
+    }
+    recordTrace(taskIndex, (traceKind) newState, 0);
 }
-// -------------------------------------------
 
-// enables or disables the cancel response for the monitor
-void setCancelState(int state) 
+// adds the wait of one iteration to the task, the metrics and the trace
+void recordTaskWait(int taskIndex, long long waitMsec)
 {
-    int rval= pthread_setcancelstate(state, NULL);
-    if (rval) {perror("Monitor cancel state change error"); exit(1); }
+    taskParameters &task = taskList[taskIndex];
+    recordTrace(taskIndex, TRACE_GRANT, task.request.shortOf);
+    task.waitTime += waitMsec;
+    if (recordWait(waitMsec))
+    {
+        task.starved += 1;
+    }
 }
 
 // prints the states of all tasks for the monitor thread
-// monitor must acquire the monitor lock in write mode before executing
 void printTaskStates(map<state, vector<string> > taskListPerState)
 {
-    cout << endl << "monitor: " << "[WAIT] ";
+    ostringstream out;
+    out << endl << "monitor: " << "[WAIT] ";
     for (vector<string>::iterator it = taskListPerState[WAIT].begin(); it != taskListPerState[WAIT].end(); ++it)
     {
-        cout << *it << " ";
+        out << *it << " ";
     }
-    cout << endl << "         [RUN]  ";
+    out << endl << "         [RUN]  ";
     for (vector<string>::iterator it = taskListPerState[RUN].begin(); it != taskListPerState[RUN].end(); ++it)
     {
-        cout << *it << " ";
+        out << *it << " ";
     }
-    cout << endl << "         [IDLE] ";
+    out << endl << "         [IDLE] ";
     for (vector<string>::iterator it = taskListPerState[IDLE].begin(); it != taskListPerState[IDLE].end(); ++it)
     {
-        cout << *it << " ";
+        out << *it << " ";
     }
-    cout << endl << endl;
+    out << endl << endl;
+    writeOutput(out.str());
 }
 
-// prints the task status after every iteration for a task thread
-// task must acquire the monitor lock in write mode before executing
-void printTaskStatus(int threadIndex)
+// returns the time since the program started in usec, or the simulated time in virtual time
+long long elapsedUsec()
 {
+    if (virtualTime)
+    {
+        return executorTimeUsec();
+    }
     struct timeval sinceStart;
     gettimeofday(&sinceStart, NULL);
-    long long waitTime = ((sinceStart.tv_sec * 1000000 + sinceStart.tv_usec) - (startTime.tv_sec * 1000000 + startTime.tv_usec)) / 1000;
+    return (sinceStart.tv_sec * 1000000LL + sinceStart.tv_usec) - (startTime.tv_sec * 1000000LL + startTime.tv_usec);
+}
+
+long long elapsedMsec()
+{
+    return elapsedUsec() / 1000;
+}
+
+// prints the task status after every iteration for a task thread
+void printTaskStatus(int threadIndex)
+{
+    long long waitTime = elapsedMsec();
  
-    cout << "task: "   << taskList[threadIndex].name << 
-            "(tid= "   << taskList[threadIndex].ntid <<
-            ", iter= " << taskList[threadIndex].numberIterations <<
-            ", time= " << waitTime << " msec)" << endl;
+    ostringstream out;
+    out << "task: "   << taskList[threadIndex].name << 
+           "(tid= "   << taskList[threadIndex].ntid <<
+           ", iter= " << taskList[threadIndex].numberIterations <<
+           ", time= " << waitTime << " msec)" << endl;
+    writeOutput(out.str());
 }
 
 // prints the system resources at the end of the program
-void printSystemResources(map<string, int> maxResources) 
+void printSystemResources() 
 {
-    cout << endl << "System Resources: " << endl;
-    for (map<string, int>::iterator it = maxResources.begin(); it != maxResources.end(); ++it)
+    ostringstream out;
+    out << endl << "System Resources: " << endl;
+    for (int id = 0; id < resourceNames.size(); ++id)
     {
-        cout << "       "       << it->first << 
-                ": (maxAvail= " << it->second <<
-                ", held= "      << it->second - resources[it->first] << ")" << endl;
+        out << "       "       << resourceNames[id] << 
+               ": (maxAvail= " << maxResources[id] <<
+               ", held= "      << maxResources[id] - availableUnits(id) << ")" << endl;
     }
+    writeOutput(out.str());
 }
 
 // prints the task results at the end of the program
 void printSystemTasks()
 {
     int count = 0;
-    cout << endl << "System Tasks:" << endl;
+    ostringstream out;
+    out << endl << "System Tasks:" << endl;
     for (int i = 0; i < numTasks; ++i)
     {
-        cout << "[" << count << "] " << taskList[i].name << " (" << 
-                STATENAME[taskList[i].taskState] << 
-                ", runTime= "   << taskList[i].busyTime << " msec" <<
-                ", idleTime= "  << taskList[i].idleTime << " msec):" << endl <<
-                "       (tid= " << taskList[i].ntid << ")" << endl;
-
-        for (int j = 0; j < taskList[i].taskResources.size(); ++j)
+        out << "[" << count << "] " << taskList[i].name << " (" << 
+               STATENAME[taskList[i].taskState.get()] << 
+               ", runTime= "   << taskList[i].busyTime << " msec" <<
+               ", idleTime= "  << taskList[i].idleTime << " msec):" << endl <<
+               "       (tid= " << taskList[i].ntid << ")" << endl;
+
+        const resourceRequest &request = taskList[i].request;
+        for (int j = 0; j < request.numResources; ++j)
         {
-            cout << "        "    << taskList[i].taskResources[j].name << 
-                    ": (needed= " << taskList[i].taskResources[j].total <<
-                    ", held= "    << taskList[i].taskResources[j].held << ")" << endl;
+            out << "        "    << resourceNames[request.needs[j].id] << 
+                   ": (needed= " << request.needs[j].total <<
+                   ", held= "    << request.needs[j].held << ")" << endl;
         }
 
-        cout << "       (RUN: "   << taskList[i].numberIterations << " times" << 
-                        ", WAIT: " << taskList[i].waitTime << " msec)" << endl << endl;
+        out << "       (RUN: "   << taskList[i].numberIterations << " times" << 
+                       ", WAIT: " << taskList[i].waitTime << " msec)" << endl << endl;
         count += 1;
     }
+    writeOutput(out.str());
 }
 
-// checks the resource pool to determine if there are enough resources to run a task
-// task must obtain the resource mutex before calling this function
-bool canAcquireResources(int threadIndex)
+// prints the total time spent waiting for resources and the CPU time used by the program
+// used to compare the ways of waiting for resources
+void printWaitSummary()
 {
-    vector<rsrc> acquiredResources = taskList[threadIndex].taskResources;
-    for (int i = 0; i < acquiredResources.size(); ++i)
+    long long totalWait = 0;
+    for (int i = 0; i < numTasks; ++i)
     {
-        string resource = acquiredResources[i].name;
-        int needed = acquiredResources[i].total;
-        // if there is not enough of a certain resource, return false
-        if (resources[resource] < needed)
+        totalWait += taskList[i].waitTime;
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    long long userTime = usage.ru_utime.tv_sec * 1000 + usage.ru_utime.tv_usec / 1000;
+    long long systemTime = usage.ru_stime.tv_sec * 1000 + usage.ru_stime.tv_usec / 1000;
+    ostringstream out;
+    out << "Total WAIT= " << totalWait << " msec (wait mode= " << WAITMODENAME[taskWaitMode] << ")" << endl;
+    out << "CPU time= " << userTime + systemTime << " msec (user= " << userTime << " msec, sys= " << systemTime << " msec)" <<
+           ", max RSS= " << usage.ru_maxrss << " KB" << endl;
+    if (taskWaitMode != ATOMIC)
+    {
+        out << "Resource mutex held " << resourceMutexHolds << " times, mean hold= " <<
+               (resourceMutexHolds > 0 ? resourceMutexHoldNsec / resourceMutexHolds : 0) << " nsec" << endl;
+    }
+    if (taskWaitMode == INCREMENTAL)
+    {
+        out << "Deadlocks= " << deadlocksResolved << " tasks rolled back, " << unitsRolledBack << " units taken back" << endl;
+    }
+    writeOutput(out.str());
+}
+
+// prints how well the grant order served the tasks: iterations completed per second, the mean
+// and tail wait per iteration, and Jain's fairness index of how fast each task progressed
+// compared to running without waiting (1 when every task was slowed down equally)
+void printSchedulerSummary(long long runTime)
+{
+    long long iterations = 0;
+    long long totalWait = 0;
+    double sum = 0, sumSquares = 0;
+    for (int i = 0; i < numTasks; ++i)
+    {
+        long long unhindered = (long long) (taskList[i].busyTime + taskList[i].idleTime) * taskList[i].numberIterations;
+        double progress = 1.0;
+        if (unhindered + taskList[i].waitTime > 0)
         {
-            return false;
+            progress = (double) unhindered / (unhindered + taskList[i].waitTime);
         }
+        sum += progress;
+        sumSquares += progress * progress;
+        iterations += taskList[i].numberIterations;
+        totalWait += taskList[i].waitTime;
     }
-    // there are enough resources to run this task
-    return true;
+
+    ostringstream out;
+    out << fixed << setprecision(3);
+    string scheduler = (taskWaitMode == QUEUE ? POLICYNAME[taskPolicy] : WAITMODENAME[taskWaitMode]);
+    out << "Scheduler= " << (managerPath.empty() ? scheduler : "manager") <<
+           ", throughput= " << (runTime > 0 ? iterations * 1000.0 / runTime : 0) << " iter/sec" <<
+           ", mean WAIT= " << (iterations > 0 ? (double) totalWait / iterations : 0) << " msec" <<
+           ", p95= " << waitPercentile(0.95) << " msec" <<
+           ", p99= " << waitPercentile(0.99) << " msec" <<
+           ", Jain fairness= " << (sumSquares > 0 ? sum * sum / (numTasks * sumSquares) : 1.0) << endl;
+    writeOutput(out.str());
 }
 
-// creates a resource
-rsrc createResource(string name, int total, int held)
+// prints the list of tasks based upon their state and takes a metrics sample
+// the states are read without stopping the tasks: they are read until two reads in a row are the
+// same, change counts included, so every task was in the state read at the moment between them
+// after SNAPSHOT_RETRIES the last read is used even if it is not consistent
+void monitorTasks()
 {
-    rsrc r = {.name = name, .total = total, .held = held};
-    return r;
+    map<state, vector<string> > taskListPerState;
+    vector<long long> states, previous;
+
+    // every task is in the list before the monitor starts
+    states.resize(numTasks);
+    previous.resize(numTasks);
+    for (int i = 0; i < numTasks; ++i)
+    {
+        states[i] = taskList[i].taskState.value.load();
+    }
+    for (int attempt = 0; attempt < SNAPSHOT_RETRIES; ++attempt)
+    {
+        states.swap(previous);
+        for (int i = 0; i < numTasks; ++i)
+        {
+            states[i] = taskList[i].taskState.value.load();
+        }
+        if (states == previous)
+        {
+            break;
+        }
+    }
+    for (int i = 0; i < numTasks; ++i)
+    {
+        taskListPerState[(state) (states[i] % 3)].push_back(taskList[i].name);
+    }
+    sampleMetrics(elapsedMsec(), taskListPerState[WAIT].size(), taskListPerState[RUN].size(), taskListPerState[IDLE].size());
+
+    printTaskStates(taskListPerState);
 }
 
 // the thread for the monitor
 void *monitorThread(void *arg)
 {
     int monitorTime = *((int *) arg);
-    map<state, vector<string> > taskListPerState;
 
     // convert to microseconds
     monitorTime = monitorTime * 1000;
     while (true)
     {
-        taskListPerState.clear();
         usleep(monitorTime);
 
-        // prevent the monitor from being cancelled while holding the rwlock
+        // prevent the monitor from being cancelled while holding the resource or output locks
         setCancelState(PTHREAD_CANCEL_DISABLE);
-        rwlock_wrlock(&monitorLock);
-
-        // print the list of tasks based upon their state
-        for (int i = 0; i < numTasks; ++i)
-        {
-            taskListPerState[taskList[i].taskState].push_back(taskList[i].name);
-        }
-        printTaskStates(taskListPerState);
-
-        rwlock_unlock(&monitorLock);
+        monitorTasks();
         // re-enable the cancel response
         setCancelState(PTHREAD_CANCEL_ENABLE);
     }
 
 }
 
+// ends the run when a managed task's connection fails: the manager is gone, or it took back a
+// grant the task still held, so another task may have used the same units at the same time
+void managerFailed(managerConnection &conn, int taskIndex)
+{
+    if (conn.expired)
+    {
+        writeOutput("ERROR: the resource manager at " + managerPath + " took back a grant task " +
+                    taskList[taskIndex].name + " still held, its lease of " + to_string(conn.leaseMsec) + " msec ran out\n");
+    }
+    else
+    {
+        writeOutput("Lost the resource manager at " + managerPath + "\n");
+    }
+    exit(1);
+}
+
 // the main task thread 
 void *taskThread(void *arg)
 {
@@ -233,80 +366,71 @@ void *taskThread(void *arg)
     delete threadIndexP;
 
     struct timeval startWaitTime, endWaitTime;
-    vector<rsrc> acquiredResources;
+
+    // managed: the task has its own connection to the resource manager
+    managerConnection conn;
+    int grantId;
+    if (!managerPath.empty() && !connectManager(conn, managerPath))
+    {
+        writeOutput("The resource manager at " + managerPath + " can not serve task " + taskList[threadIndex].name + "\n");
+        exit(1);
+    }
 
     while (taskList[threadIndex].numberIterations < NITER) 
     {
         // attempt to acquire all resources
-        rwlock_rdlock(&monitorLock);
-        taskList[threadIndex].taskState = WAIT;
-        rwlock_unlock(&monitorLock);
+        setTaskState(threadIndex, WAIT);
+        taskList[threadIndex].request.shortOf = -1;
 
         gettimeofday(&startWaitTime, NULL);
-        while (true)
-        {   
-            if (taskList[threadIndex].taskResources.size() == 0)
-            {
-                // task doesn't need any resources
-                break;
-            }
-            bool success = false;
-            mutex_lock(&resourceMutex);
-
-            if (canAcquireResources(threadIndex))
-            {
-                acquiredResources = taskList[threadIndex].taskResources;
-                for (int i = 0; i < acquiredResources.size(); ++i)
-                {
-                    string resource = acquiredResources[i].name;
-                    int needed = acquiredResources[i].total;
-                    resources[resource] -= needed;
-                    acquiredResources[i].held = needed;
-                } 
-                // commit the changes to the resources
-                taskList[threadIndex].taskResources = acquiredResources;
-                success = true;         
-            }
-
-            mutex_unlock(&resourceMutex);
-            if (success) 
-            {
-                break;
-            }
-            usleep(10*1000);
+        if (managerPath.empty())
+        {
+            acquireResources(taskList[threadIndex].request);
+        }
+        else if ((grantId = managerAcquire(conn, taskList[threadIndex].request)) < 0)
+        {
+            managerFailed(conn, threadIndex);
         }
         // resources successfully obtained
         
         // calculate the time spent waiting
         gettimeofday(&endWaitTime, NULL);
         long long waitTime = ((endWaitTime.tv_sec * 1000000 + endWaitTime.tv_usec) - (startWaitTime.tv_sec * 1000000 + startWaitTime.tv_usec)) / 1000;
-        taskList[threadIndex].waitTime += waitTime;
+        recordTaskWait(threadIndex, waitTime);
 
         // hold the resources for busyTime
-        rwlock_rdlock(&monitorLock);
-        taskList[threadIndex].taskState = RUN;
-        rwlock_unlock(&monitorLock);
+        setTaskState(threadIndex, RUN);
 
-        usleep(taskList[threadIndex].busyTime * 1000);
+        // a managed task renews its lease every half lease while it is busy
+        int busyLeft = taskList[threadIndex].busyTime;
+        int period = managerPath.empty() ? busyLeft : max(conn.leaseMsec / 2, 1);
+        while (true)
+        {
+            int busy = min(busyLeft, period);
+            doWork(busy, taskList[threadIndex].request);
+            busyLeft -= busy;
+            if (busyLeft == 0)
+            {
+                break;
+            }
+            if (!managerRenew(conn, grantId))
+            {
+                managerFailed(conn, threadIndex);
+            }
+        }
         
         // release all resources
-        mutex_lock(&resourceMutex);
-        acquiredResources = taskList[threadIndex].taskResources;
-        for (int i = 0; i < acquiredResources.size(); ++i)
+        if (managerPath.empty())
         {
-            string resource = acquiredResources[i].name;
-            int needed = acquiredResources[i].total;
-
-            resources[resource] += needed;
-            acquiredResources[i].held = 0;
+            releaseResources(taskList[threadIndex].request);
+        }
+        else if (!managerRelease(conn, grantId))
+        {
+            managerFailed(conn, threadIndex);
         }
-        taskList[threadIndex].taskResources = acquiredResources;
-        mutex_unlock(&resourceMutex);
 
         // enter idle state 
-        rwlock_rdlock(&monitorLock);
-        taskList[threadIndex].taskState = IDLE;
-        rwlock_unlock(&monitorLock);
+        setTaskState(threadIndex, IDLE);
 
         usleep(taskList[threadIndex].idleTime * 1000);
 
@@ -314,31 +438,269 @@ void *taskThread(void *arg)
         taskList[threadIndex].numberIterations += 1;
 
         // print iteration complete message for task
-        rwlock_wrlock(&monitorLock);
         printTaskStatus(threadIndex);
-        rwlock_unlock(&monitorLock);
     }
 
+    if (!managerPath.empty())
+    {
+        closeManager(conn);
+    }
+    recordTrace(threadIndex, TRACE_DONE, 0);
     pthread_exit(NULL);
 }
 
+// executor: a queued task has been granted its resources
+void taskGranted(int taskIndex)
+{
+    readyTask(taskIndex);
+}
+
+// executor: advances a task through the same WAIT -> RUN -> IDLE loop as taskThread
+// busy and idle periods are executor timers, so the worker is free for other tasks meanwhile
+// times come from the executor clock so the same steps work in virtual time
+void stepTask(int taskIndex)
+{
+    taskParameters &task = taskList[taskIndex];
+    switch (task.phase)
+    {
+        case START_ITERATION:
+            // attempt to acquire all resources
+            setTaskState(taskIndex, WAIT);
+            task.request.shortOf = -1;
+            task.startWaitTime = executorTimeUsec();
+            // fall through
+        case ACQUIRE:
+            task.phase = GRANTED;
+            if (!requestResources(task.request))
+            {
+                if (taskWaitMode == POLL)
+                {
+                    // try again in 10 msec
+                    task.phase = ACQUIRE;
+                    scheduleTask(taskIndex, 10);
+                }
+                // queue and incremental: taskGranted makes the task ready once it is granted its resources,
+                // possibly on another worker already, so the task must not be touched here
+                return;
+            }
+            // resources obtained at once, fall through
+        case GRANTED:
+            // calculate the time spent waiting
+            recordTaskWait(taskIndex, (executorTimeUsec() - task.startWaitTime) / 1000);
+
+            // hold the resources for busyTime
+            setTaskState(taskIndex, RUN);
+            task.phase = BUSY_DONE;
+            if (taskWorkMode == SLEEP)
+            {
+                scheduleTask(taskIndex, task.busyTime);
+            }
+            else
+            {
+                // the busy time is spent on this worker
+                doWork(task.busyTime, task.request);
+                scheduleTask(taskIndex, 0);
+            }
+            break;
+        case BUSY_DONE:
+            // release all resources and enter idle state
+            releaseResources(task.request);
+            setTaskState(taskIndex, IDLE);
+            task.phase = IDLE_DONE;
+            scheduleTask(taskIndex, task.idleTime);
+            break;
+        case IDLE_DONE:
+            // iteration complete
+            task.numberIterations += 1;
+            task.ntid = pthread_self();
+            printTaskStatus(taskIndex);
+
+            if (task.numberIterations < NITER)
+            {
+                task.phase = START_ITERATION;
+                readyTask(taskIndex);
+            }
+            else
+            {
+                recordTrace(taskIndex, TRACE_DONE, 0);
+                finishTask();
+            }
+            break;
+    }
+}
+
+// coroutines: the same WAIT -> RUN -> IDLE loop as taskThread, suspending instead of blocking
+taskCoroutine taskBody(int taskIndex)
+{
+    taskParameters &task = taskList[taskIndex];
+    while (task.numberIterations < NITER)
+    {
+        // attempt to acquire all resources
+        setTaskState(taskIndex, WAIT);
+        task.request.shortOf = -1;
+        long long startWaitTime = executorTimeUsec();
+        while (!co_await resourcesFor(taskIndex, task.request))
+        {
+            // poll: not available yet, tried again after 10 msec
+        }
+        recordTaskWait(taskIndex, (executorTimeUsec() - startWaitTime) / 1000);
+
+        // hold the resources for busyTime
+        setTaskState(taskIndex, RUN);
+        if (taskWorkMode == SLEEP)
+        {
+            co_await sleepFor(taskIndex, task.busyTime);
+        }
+        else
+        {
+            // the busy time is spent on this worker
+            doWork(task.busyTime, task.request);
+            co_await sleepFor(taskIndex, 0);
+        }
+
+        // release all resources and enter idle state
+        releaseResources(task.request);
+        setTaskState(taskIndex, IDLE);
+        co_await sleepFor(taskIndex, task.idleTime);
+
+        // iteration complete
+        task.numberIterations += 1;
+        task.ntid = pthread_self();
+        printTaskStatus(taskIndex);
+        if (task.numberIterations < NITER)
+        {
+            // start the next iteration behind the tasks that are already ready, as stepTask does
+            co_await yieldTask(taskIndex);
+        }
+    }
+    recordTrace(taskIndex, TRACE_DONE, 0);
+    finishTask();
+}
+
+// coroutines: the executor step, continues a task's coroutine up to its next co_await
+void resumeTask(int taskIndex)
+{
+    coroutines[taskIndex].handle.resume();
+}
+
 int main(int argc, char *argv[])
 {
     // specify the program start time
     struct timeval endTime;
     gettimeofday(&startTime, NULL);
+
+    // everything buffered is written out however the program exits
+    startOutputWriter();
+    atexit(stopOutputWriter);
+
+    // process the options
+    int opt;
+    string metricsFile;
+    string traceFile;
+    int starvationMsec = STARVATION_MSEC;
+    while ((opt = getopt(argc, argv, "m:s:x:vcw:o:t:T:u:")) != -1)
+    {
+        if (opt == 'm' && string(optarg).compare(WAITMODENAME[POLL]) == 0)
+        {
+            taskWaitMode = POLL;
+        }
+        else if (opt == 'm' && string(optarg).compare(WAITMODENAME[QUEUE]) == 0)
+        {
+            taskWaitMode = QUEUE;
+        }
+        else if (opt == 'm' && string(optarg).compare(WAITMODENAME[ATOMIC]) == 0)
+        {
+            taskWaitMode = ATOMIC;
+        }
+        else if (opt == 'm' && string(optarg).compare(WAITMODENAME[INCREMENTAL]) == 0)
+        {
+            taskWaitMode = INCREMENTAL;
+        }
+        else if (opt == 's' && policyFromName(optarg) >= 0)
+        {
+            taskPolicy = (schedulePolicy) policyFromName(optarg);
+        }
+        else if (opt == 'x' && atoi(optarg) > 0)
+        {
+            executorWorkers = atoi(optarg);
+        }
+        else if (opt == 'v')
+        {
+            virtualTime = true;
+        }
+        else if (opt == 'c')
+        {
+            coroutineTasks = true;
+        }
+        else if (opt == 'w' && workModeFromName(optarg, taskWorkMode))
+        {
+            // work mode selected
+        }
+        else if (opt == 'o')
+        {
+            metricsFile = optarg;
+        }
+        else if (opt == 't' && atoi(optarg) >= 0)
+        {
+            starvationMsec = atoi(optarg);
+        }
+        else if (opt == 'T')
+        {
+            traceFile = optarg;
+            enableTrace();
+        }
+        else if (opt == 'u')
+        {
+            managerPath = optarg;
+        }
+        else
+        {
+            writeOutput("usage: a4tasks [-m poll|queue|atomic|incremental] [-s firstfit|fifo|sbtf|priority|lottery] [-x workers] [-v] [-c] "
+                        "[-w sleep|spin|compute|mem|shared] [-o metricsFile] [-t starvationMsec] [-T traceFile] [-u socketPath] inputFile monitorTime NITER\n");
+            return 1;
+        }
+    }
+    // virtual time steps every task on the executor from this thread
+    if (coroutineTasks && executorWorkers == 0)
+    {
+        // a single threaded scheduler unless more workers are asked for
+        executorWorkers = 1;
+    }
+    bool useExecutor = (executorWorkers > 0 || virtualTime);
+    if (useExecutor && taskWaitMode == ATOMIC)
+    {
+        // atomic waits sleep on a futex, which would block a worker
+        writeOutput("The atomic wait mode needs a thread per task.\n");
+        return 1;
+    }
+    if (virtualTime && taskWorkMode != SLEEP)
+    {
+        // virtual time never runs the busy periods
+        writeOutput("Busy work needs real time.\n");
+        return 1;
+    }
+    if (taskPolicy != FIRSTFIT && taskWaitMode != QUEUE)
+    {
+        // only the queue keeps the waiting tasks for a scheduler to choose from
+        writeOutput("Scheduling policies need the queue wait mode.\n");
+        return 1;
+    }
+    if (!managerPath.empty() && (useExecutor || taskWaitMode != QUEUE || taskPolicy != FIRSTFIT))
+    {
+        // the manager keeps the waiting tasks, and a task blocks on its connection
+        writeOutput("The resource manager needs a thread per task and the default wait mode and policy.\n");
+        return 1;
+    }
+    argc -= optind - 1;
+    argv += optind - 1;
+
     if (argc == 4) 
     {
-        // initialize mutexes and locks
-        mutex_init(&resourceMutex);
-        rwlock_init(&monitorLock);
+        // initialize the resource pool
+        initResourcePool(taskWaitMode, taskPolicy);
+        initWork(taskWorkMode);
 
         int rval;
-        map<string, int> maxResources;
-
-        // initialize global variables
-        resources.clear();
-        maxResources.clear();
 
         // process the input
         string inputFile;
@@ -347,161 +709,189 @@ int main(int argc, char *argv[])
         monitorTime = atoi(argv[2]);
         NITER = atoi(argv[3]);
 
-        FILE *fp;
-        // open the input file
-        if ((fp = fopen(inputFile.c_str(), "r")) == NULL)
-        {               
-            rwlock_wrlock(&monitorLock);
-            cout << "Provided input file is invalid: " << inputFile << endl;
-            rwlock_unlock(&monitorLock); 
+        // read and check the whole input file before anything is started
+        inputSpec input;
+        string error;
+        if (!parseInput(inputFile, input, error))
+        {
+            writeOutput("ERROR: " + error + "\n");
             return 1;
         }
+        for (int id = 0; id < input.resourceNames.size(); ++id)
+        {
+            addResource(input.resourceNames[id], input.resourceUnits[id]);
+        }
+        if (virtualTime)
+        {
+            // the tasks are set up at virtual time 0
+            startVirtualClock();
+        }
+        if (!initMetrics(starvationMsec, metricsFile, elapsedUsec))
+        {
+            writeOutput("Can not open metrics file: " + metricsFile + "\n");
+            return 1;
+        }
+        int numberTasks = input.tasks.size();
+        if (!useExecutor && numberTasks > NTASKS)
+        {   // no more task threads allowed
+            writeOutput("Max number of tasks started\n");
+            numberTasks = NTASKS;
+        }
 
-        // start the monitoring thread
+        // running tasks refer to their entries, the list is complete before any task starts
+        taskList.resize(numberTasks);
+        for (int i = 0; i < numberTasks; ++i)
+        {
+            const taskSpec &spec = input.tasks[i];
+            taskParameters &task = taskList[i];
+            task.name = spec.name;
+            task.busyTime = spec.busyTime;
+            task.idleTime = spec.idleTime;
+            task.taskState.value = WAIT; // set the initial state to wait
+            task.numberIterations = 0;
+            task.waitTime = 0;
+            task.starved = 0;
+            task.ntid = 0;
+            task.phase = START_ITERATION;
+            initRequest(task.request);
+            task.request.busyTime = task.busyTime;
+            for (int j = 0; j < spec.numNeeds; ++j)
+            {
+                addNeed(task.request, spec.needIDs[j], spec.needUnits[j]);
+            }
+            if (useExecutor)
+            {
+                // the executor starts every task once the monitor is running
+                task.request.grantCallback = taskGranted;
+                task.request.owner = i;
+            }
+        }
+        numTasks = numberTasks;
+        // every task starts out waiting
+        initWaitingClocks(numTasks);
+        for (int i = 0; i < numTasks; ++i)
+        {
+            recordWaitingChange(i, true);
+        }
+
+        // start the monitoring thread, in virtual time the executor calls the monitor instead
         pthread_t monitor_tid;
-        rval = pthread_create(&monitor_tid, NULL, monitorThread, (void *) &monitorTime);
+        rval = virtualTime ? 0 : pthread_create(&monitor_tid, NULL, monitorThread, (void *) &monitorTime);
         if (rval) 
         {
-            rwlock_wrlock(&monitorLock);
             perror("Error creating monitor thread");
-            rwlock_unlock(&monitorLock); 
             exit(1); 
         }
 
-        // read the input file and take appropriate actions
-        char buf[MAXLINE];
-        while (fgets(buf, MAXLINE, fp) != NULL)
+        for (int i = 0; i < numTasks && !useExecutor; ++i)
         {
-            string line(buf);
-            istringstream wordstream(line);
-            vector<string> words((istream_iterator<string>(wordstream)),
-                                            istream_iterator<string>());
-            if (words.size() == 0 || words[0][0] == '#')
+            // allocate memory for the index of the new task
+            int *idxPointer = new int;
+            *idxPointer = i;
+
+            // start the new task, pass it the pointer to its index in the taskList
+            rval = pthread_create(&taskList[i].ntid, NULL, taskThread, (void *) idxPointer);
+            if (rval) 
             {
-                // comment line or a blank line
-                continue;
-            }
-            else
-            {   
-                // look for a resources or task line
-                if (words[0].compare("resources") == 0) 
-                {
-                    if (resources.size() > 1)
-                    {   // resources already declared
-                        rwlock_wrlock(&monitorLock);
-                        cout << "ERROR: Two resource lines specified" << endl;
-                        rwlock_unlock(&monitorLock);
-                        exit(1);
-                    }
-                    int numberResources = words.size() - 1;
-                    if (numberResources > NRES_TYPES)
-                    {   // can only have at most 10 resource types
-                        numberResources = NRES_TYPES;
-                    }
-                    for (int i = 1; i < numberResources + 1; ++i)
-                    {
-                        // store a map of the resource keys and totals
-                        // store another map for the currently available resources
-                        int colonIndex = words[i].find(":");
-                        string name = words[i].substr(0, colonIndex);
-                        int value = atoi(words[i].substr(colonIndex+1, words[i].length() - colonIndex).c_str());
-                        maxResources.insert(pair<string, int>(name, value));
-                        resources.insert(pair<string, int>(name, value));
-                    }
-                }
-                else if (words[0].compare("task") == 0)
-                {
-                    if (resources.size() < 1) 
-                    {   // no resources exist
-                        rwlock_wrlock(&monitorLock);
-                        cout << "ERROR: No resources declared before task" << endl;
-                        rwlock_unlock(&monitorLock);
-                        exit(1);
-                    }
-                    if (numTasks >= 25) 
-                    {   // no more tasks allowed
-                        rwlock_wrlock(&monitorLock);
-                        cout << "Max number of tasks started" << endl;
-                        rwlock_unlock(&monitorLock);
-                        break;
-                    }
-
-                    // create a new task
-                    taskParameters task;
-                    task.name = words[1];
-                    task.busyTime = atoi(words[2].c_str());
-                    task.idleTime = atoi(words[3].c_str());
-                    task.taskState = WAIT; // set the initial state to wait
-                    task.numberIterations = 0;
-                    task.waitTime = 0;
-                    task.ntid = 0;
-
-                    // set the new task's required resources
-                    for (int i = 4; i < words.size(); ++i)
-                    {
-                        int colonIndex = words[i].find(":");
-                        string name = words[i].substr(0, colonIndex);
-                        int value = atoi(words[i].substr(colonIndex+1, words[i].length() - colonIndex).c_str());
-                        if (maxResources.find(name) == resources.end())
-                        {   // no matching resource
-                            rwlock_wrlock(&monitorLock);
-                            cout << "Task " << task.name << " requires resources that don't exist" << endl;
-                            rwlock_unlock(&monitorLock);
-                            exit(1);
-                        }
-                        else if (maxResources[name] < value) 
-                        {   // too many resources required
-                            rwlock_wrlock(&monitorLock);
-                            cout << "Task " << task.name << " requires more of resource " << name << " then are available" << endl;
-                            rwlock_unlock(&monitorLock);
-                            exit(1);
-                        }
-                        task.taskResources.push_back(createResource(name, value, 0));
-                    }
-
-                    // allocate memory for the index of the new task
-                    int *idxPointer = new int;
-                    *idxPointer = numTasks;
-
-                    taskList[numTasks] = task;
-
-                    // start the new task, pass it the pointer to its index in the taskList
-                    rval = pthread_create(&taskList[numTasks].ntid, NULL, taskThread, (void *) idxPointer);
-                    if (rval) 
-                    {
-                        perror("Error creating task thread"); 
-                        exit(1); 
-                    }
-                    
-                    // update the number of tasks, make sure the monitor is not printing when we do this
-                    rwlock_wrlock(&monitorLock);
-                    numTasks++;
-                    rwlock_unlock(&monitorLock);              
-                }
+                perror("Error creating task thread"); 
+                exit(1); 
             }
         }
 
-        fclose(fp);
+        // the executor either steps the task state machines or resumes the task coroutines
+        taskStepFunction step = stepTask;
+        if (coroutineTasks)
+        {
+            for (int i = 0; i < numTasks; ++i)
+            {
+                coroutines.push_back(taskBody(i));
+            }
+            step = resumeTask;
+        }
 
-        // wait for all threads to finish
-        for (int i = 0; i < numTasks; ++i)
+        if (virtualTime)
+        {
+            // simulate every task until all of them have finished
+            if (!runVirtualExecutor(numTasks, step, monitorTime, monitorTasks))
+            {
+                writeOutput("ERROR: Tasks are waiting for resources that will never be released\n");
+            }
+        }
+        else if (executorWorkers > 0)
+        {
+            // run every task on the worker pool until all of them have finished
+            runExecutor(executorWorkers, numTasks, step);
+        }
+        else
+        {
+            // wait for all threads to finish
+            for (int i = 0; i < numTasks; ++i)
+            {
+                pthread_join(taskList[i].ntid, NULL);
+            }
+        }
+        for (int i = 0; i < coroutines.size(); ++i)
         {
-            pthread_join(taskList[i].ntid, NULL);
+            coroutines[i].handle.destroy();
         }
 
         // all threads have finished, exit the monitor thread and display output
-        pthread_cancel(monitor_tid);
-        pthread_join(monitor_tid, NULL);
+        if (!virtualTime)
+        {
+            pthread_cancel(monitor_tid);
+            pthread_join(monitor_tid, NULL);
+        }
 
-        printSystemResources(maxResources);
+        printSystemResources();
         printSystemTasks();
         gettimeofday(&endTime, NULL);
         long long runTime = ((endTime.tv_sec * 1000000 + endTime.tv_usec) - (startTime.tv_sec * 1000000 + startTime.tv_usec)) / 1000;
-        cout << "Running time= " << runTime << " msec" << endl;
+        ostringstream out;
+        if (virtualTime)
+        {
+            out << "Running time= " << elapsedMsec() << " msec (virtual, wall time= " << runTime << " msec)" << endl;
+            runTime = elapsedMsec();
+        }
+        else
+        {
+            out << "Running time= " << runTime << " msec" << endl;
+        }
+        writeOutput(out.str());
+        printWaitSummary();
+        printSchedulerSummary(runTime);
+        if (taskWorkMode != SLEEP)
+        {
+            printWorkSummary();
+        }
+
+        // a last sample for the export once every task has finished, then the metrics report
+        int counts[3] = {0, 0, 0};
+        int starvedTasks = 0;
+        for (int i = 0; i < numTasks; ++i)
+        {
+            counts[taskList[i].taskState.get()] += 1;
+            starvedTasks += (taskList[i].starved > 0);
+        }
+        sampleMetrics(elapsedMsec(), counts[WAIT], counts[RUN], counts[IDLE]);
+        printMetricsReport(starvedTasks);
+        closeMetrics();
+
+        if (traceEnabled())
+        {
+            vector<string> taskNames;
+            for (int i = 0; i < numTasks; ++i)
+            {
+                taskNames.push_back(taskList[i].name);
+            }
+            if (!writeTrace(traceFile, taskNames))
+            {
+                writeOutput("Can not write trace file: " + traceFile + "\n");
+            }
+        }
     }
     else
     {
-        cout << "Incorrect number of arguments specified" << endl;
+        writeOutput("Incorrect number of arguments specified\n");
     }
     return 0;
 } 
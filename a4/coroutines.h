@@ -0,0 +1,102 @@
+#ifndef COROUTINES_H
+#define COROUTINES_H
+
+#include "libraries.h"
+#include "resources.h"
+#include "executor.h"
+
+#include <coroutine>
+
+/* COROUTINE TASKS
+A task can be written as a C++20 coroutine that runs on the executor: the executor resumes it
+when it is ready and it suspends at every co_await, so the WAIT -> RUN -> IDLE loop reads like
+taskThread but a task only costs its coroutine frame rather than a thread and its stack.
+
+    co_await sleepFor(taskIndex, msec)              suspends for msec on an executor timer
+    co_await yieldTask(taskIndex)                   goes to the back of the ready tasks
+    co_await resourcesFor(taskIndex, request)       true once the resources are held
+
+In queue mode a request that can not be granted waits in the resource pool and the grant
+callback of the request makes the task ready again. In poll mode the awaiter resumes after
+10 msec with false and the task tries again. Nothing may touch an awaiter once the request is
+queued, the grant may already be resuming the coroutine on another worker.
+*/
+
+// a coroutine the executor can resume, it starts suspended and stays suspended at the end so
+// the owner destroys the frame once the executor has finished
+struct taskCoroutine
+{
+    struct promise_type
+    {
+        taskCoroutine get_return_object()
+        {
+            return taskCoroutine(coroutine_handle<promise_type>::from_promise(*this));
+        }
+        suspend_always initial_suspend() noexcept { return suspend_always(); }
+        suspend_always final_suspend() noexcept { return suspend_always(); }
+        void return_void() {}
+        void unhandled_exception() { terminate(); }
+    };
+
+    coroutine_handle<promise_type> handle;
+
+    taskCoroutine() : handle(NULL) {}
+    explicit taskCoroutine(coroutine_handle<promise_type> h) : handle(h) {}
+};
+
+// suspends a coroutine task for msec on an executor timer
+struct sleepFor
+{
+    int taskIndex;
+    int msec;
+
+    sleepFor(int index, int delayMsec) : taskIndex(index), msec(delayMsec) {}
+    bool await_ready() { return false; }
+    void await_suspend(coroutine_handle<>) { scheduleTask(taskIndex, msec); }
+    void await_resume() {}
+};
+
+// lets the other ready tasks run before a coroutine task continues
+struct yieldTask
+{
+    int taskIndex;
+
+    explicit yieldTask(int index) : taskIndex(index) {}
+    bool await_ready() { return false; }
+    void await_suspend(coroutine_handle<>) { readyTask(taskIndex); }
+    void await_resume() {}
+};
+
+// tries to obtain the resources of a request, suspending the coroutine task while it waits
+struct resourcesFor
+{
+    int taskIndex;
+    resourceRequest &request;
+    bool granted;
+
+    resourcesFor(int index, resourceRequest &req) : taskIndex(index), request(req), granted(false) {}
+    bool await_ready() { return false; }
+
+    // returns false to carry on at once when the resources are obtained
+    bool await_suspend(coroutine_handle<>)
+    {
+        if (requestResources(request))
+        {
+            granted = true;
+            return false;
+        }
+        if (resourceWaitMode == POLL)
+        {
+            // try again in 10 msec
+            scheduleTask(taskIndex, 10);
+        }
+        // queue and incremental: the grant callback makes the task ready, this awaiter must not
+        // be touched again
+        return true;
+    }
+
+    // a queued request is only resumed once it is granted
+    bool await_resume() { return granted || resourceWaitMode != POLL; }
+};
+
+#endif
@@ -0,0 +1,231 @@
+#include "executor.h"
+#include "locks.h"
+
+#include <queue>
+#include <deque>
+
+// a task that becomes ready at due
+struct timerEvent
+{
+    long long due;      // monotonic time in microseconds
+    long long sequence; // timers due at the same time fire in the order they were scheduled
+    int taskIndex;
+};
+
+// orders the timer heap so the earliest timer is on top
+struct laterTimer
+{
+    bool operator()(const timerEvent &a, const timerEvent &b) const
+    {
+        if (a.due != b.due)
+        {
+            return a.due > b.due;
+        }
+        return a.sequence > b.sequence;
+    }
+};
+
+pthread_mutex_t executorMutex;
+pthread_cond_t executorCond;    // signalled when a task becomes ready, a timer is added or the last task finishes
+deque<int> readyTasks;
+priority_queue<timerEvent, vector<timerEvent>, laterTimer> timers;
+long long timerSequence = 0;
+int remainingTasks = 0;
+taskStepFunction step;
+bool virtualClock = false;      // time only advances when the executor jumps to the next timer
+long long virtualNow = 0;       // virtual time in microseconds since the executor started
+
+// returns the monotonic time in microseconds
+long long monotonicUsec()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+// sets the executor time to virtual time 0, where it stays until the virtual executor runs, so
+// times taken while the tasks are set up are at the start of the simulation
+void startVirtualClock()
+{
+    virtualClock = true;
+    virtualNow = 0;
+}
+
+// returns the executor time in microseconds, virtual time if the executor has a virtual clock
+long long executorTimeUsec()
+{
+    if (virtualClock)
+    {
+        return virtualNow;
+    }
+    return monotonicUsec();
+}
+
+// makes a task runnable on the next free worker
+void readyTask(int taskIndex)
+{
+    mutex_lock(&executorMutex);
+    readyTasks.push_back(taskIndex);
+    cond_signal(&executorCond);
+    mutex_unlock(&executorMutex);
+}
+
+// makes a task runnable once delayMsec has passed
+void scheduleTask(int taskIndex, int delayMsec)
+{
+    timerEvent timer;
+    timer.due = executorTimeUsec() + delayMsec * 1000LL;
+    timer.taskIndex = taskIndex;
+
+    mutex_lock(&executorMutex);
+    timer.sequence = timerSequence++;
+    timers.push(timer);
+    // the new timer may be earlier than the one the workers are waiting for
+    cond_signal(&executorCond);
+    mutex_unlock(&executorMutex);
+}
+
+// records that a task has completed, the workers exit once every task has
+void finishTask()
+{
+    mutex_lock(&executorMutex);
+    remainingTasks -= 1;
+    if (remainingTasks == 0)
+    {
+        cond_broadcast(&executorCond);
+    }
+    mutex_unlock(&executorMutex);
+}
+
+// the worker thread, runs ready tasks and fires the timers that are due
+void *workerThread(void *arg)
+{
+    mutex_lock(&executorMutex);
+    while (true)
+    {
+        long long now = monotonicUsec();
+        while (!timers.empty() && timers.top().due <= now)
+        {
+            readyTasks.push_back(timers.top().taskIndex);
+            timers.pop();
+        }
+        if (!readyTasks.empty())
+        {
+            int taskIndex = readyTasks.front();
+            readyTasks.pop_front();
+            mutex_unlock(&executorMutex);
+            step(taskIndex);
+            mutex_lock(&executorMutex);
+            continue;
+        }
+        if (remainingTasks == 0)
+        {
+            break;
+        }
+        if (!timers.empty())
+        {
+            // sleep until the earliest timer is due or something changes
+            struct timespec deadline;
+            deadline.tv_sec = timers.top().due / 1000000;
+            deadline.tv_nsec = (timers.top().due % 1000000) * 1000;
+            cond_timedwait(&executorCond, &executorMutex, &deadline);
+        }
+        else
+        {
+            cond_wait(&executorCond, &executorMutex);
+        }
+    }
+    mutex_unlock(&executorMutex);
+    pthread_exit(NULL);
+}
+
+// initializes the executor and makes every task ready
+void initExecutor(int numTasks, taskStepFunction stepFunction)
+{
+    mutex_init(&executorMutex);
+
+    // timer deadlines are monotonic
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    int rval = pthread_cond_init(&executorCond, &attr);
+    if (rval) {perror("Problem initializing condition variable"); exit(1); }
+    pthread_condattr_destroy(&attr);
+
+    step = stepFunction;
+    remainingTasks = numTasks;
+    for (int i = 0; i < numTasks; ++i)
+    {
+        readyTasks.push_back(i);
+    }
+}
+
+// runs every task from the start on numWorkers threads and returns when all of them have finished
+void runExecutor(int numWorkers, int numTasks, taskStepFunction stepFunction)
+{
+    initExecutor(numTasks, stepFunction);
+    if (numTasks == 0)
+    {
+        return;
+    }
+
+    int rval;
+    vector<pthread_t> workers(numWorkers);
+    for (int i = 0; i < numWorkers; ++i)
+    {
+        rval = pthread_create(&workers[i], NULL, workerThread, NULL);
+        if (rval) {perror("Error creating worker thread"); exit(1); }
+    }
+    for (int i = 0; i < numWorkers; ++i)
+    {
+        pthread_join(workers[i], NULL);
+    }
+}
+
+// runs every task from the start on the calling thread against a virtual clock
+// tick is called every tickPeriodMsec of virtual time, returns false if tasks were left waiting
+// for resources with no timer left to release them
+bool runVirtualExecutor(int numTasks, taskStepFunction stepFunction, int tickPeriodMsec, tickFunction tick)
+{
+    startVirtualClock();
+    initExecutor(numTasks, stepFunction);
+    long long nextTick = tickPeriodMsec * 1000LL;
+
+    mutex_lock(&executorMutex);
+    while (remainingTasks > 0)
+    {
+        if (!readyTasks.empty())
+        {
+            int taskIndex = readyTasks.front();
+            readyTasks.pop_front();
+            mutex_unlock(&executorMutex);
+            step(taskIndex);
+            mutex_lock(&executorMutex);
+            continue;
+        }
+        if (timers.empty())
+        {
+            break;
+        }
+        long long due = timers.top().due;
+        if (tick != NULL && tickPeriodMsec > 0 && nextTick <= due)
+        {
+            virtualNow = nextTick;
+            nextTick += tickPeriodMsec * 1000LL;
+            mutex_unlock(&executorMutex);
+            tick();
+            mutex_lock(&executorMutex);
+            continue;
+        }
+        // jump to the earliest timer and make every task due then ready
+        virtualNow = due;
+        while (!timers.empty() && timers.top().due == virtualNow)
+        {
+            readyTasks.push_back(timers.top().taskIndex);
+            timers.pop();
+        }
+    }
+    bool finished = (remainingTasks == 0);
+    mutex_unlock(&executorMutex);
+    return finished;
+}
@@ -0,0 +1,38 @@
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+#include "libraries.h"
+
+/* EXECUTOR
+Runs any number of logical tasks on a fixed pool of worker threads. A task is a state machine
+advanced by the step function on whichever worker picks it up. A step never blocks: it either
+schedules a timer for the task, leaves it to be made ready again (by a resource grant) or
+finishes it. Busy and idle periods are timers in a heap rather than sleeping threads, so the
+number of tasks is limited by memory rather than by threads.
+
+With a virtual clock there are no worker threads: the tasks run one step at a time on the
+calling thread, and when no task is ready the clock jumps to the earliest timer. Timers are
+never waited for, so a run is deterministic and only takes as long as the steps themselves.
+*/
+typedef void (*taskStepFunction)(int taskIndex);
+
+// called every tick period of virtual time while tasks remain
+typedef void (*tickFunction)();
+
+// executor function declarations
+void runExecutor(int numWorkers, int numTasks, taskStepFunction stepFunction);
+
+bool runVirtualExecutor(int numTasks, taskStepFunction stepFunction, int tickPeriodMsec, tickFunction tick);
+
+void startVirtualClock();
+
+long long executorTimeUsec();
+
+void readyTask(int taskIndex);
+
+void scheduleTask(int taskIndex, int delayMsec);
+
+void finishTask();
+// end executor function declarations
+
+#endif
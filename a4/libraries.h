@@ -5,13 +5,16 @@
 #include <iostream>
 #include <pthread.h>
 #include <sys/time.h>
+#include <sys/resource.h> // getrusage
 #include <stdlib.h> //atoi(), exit()
-#include <unistd.h> //STDIN_FILENO, STDOUT_FILENO, usleep
+#include <unistd.h> //STDIN_FILENO, STDOUT_FILENO, usleep, getopt
 #include <map>
 #include <vector>
 #include <sstream>
+#include <iomanip> // setprecision
 #include <iterator>
 #include <stdio.h> // fopen, fdopen, fread, fwrite
+#include <errno.h> // ETIMEDOUT
 
 using namespace std;
 
@@ -0,0 +1,87 @@
+#include "locks.h"
+
+// -------------------------------------------
+// mutex functions borrowed from "Experiments involving race conditions in multithreaded programs"
+// located on the course website
+// all mutex-like functions used are similar to these
+void mutex_init(pthread_mutex_t* mutex)
+{
+    int rval= pthread_mutex_init(mutex, NULL);
+    if (rval) {perror("Problem initializing mutex"); exit(1); }
+}    
+
+void mutex_lock(pthread_mutex_t* mutex)
+{
+    int rval= pthread_mutex_lock(mutex);
+    if (rval) {perror("Lock error for mutex"); exit(1); }
+}    
+
+void mutex_unlock(pthread_mutex_t* mutex)
+{
+    int rval= pthread_mutex_unlock(mutex);
+    if (rval) {perror("Unlock error for mutex"); exit(1); }
+}
+// -------------------------------------------
+
+// -------------------------------------------
+// condition variable functions
+void cond_init(pthread_cond_t* cond)
+{
+    int rval = pthread_cond_init(cond, NULL);
+    if (rval) {perror("Problem initializing condition variable"); exit(1); }
+}
+
+void cond_wait(pthread_cond_t* cond, pthread_mutex_t* mutex)
+{
+    int rval = pthread_cond_wait(cond, mutex);
+    if (rval) {perror("Wait error for condition variable"); exit(1); }
+}
+
+void cond_signal(pthread_cond_t* cond)
+{
+    int rval = pthread_cond_signal(cond);
+    if (rval) {perror("Signal error for condition variable"); exit(1); }
+}
+
+void cond_broadcast(pthread_cond_t* cond)
+{
+    int rval = pthread_cond_broadcast(cond);
+    if (rval) {perror("Broadcast error for condition variable"); exit(1); }
+}
+
+// returns false if the deadline passed before the condition variable was signalled
+bool cond_timedwait(pthread_cond_t* cond, pthread_mutex_t* mutex, const struct timespec* deadline)
+{
+    int rval = pthread_cond_timedwait(cond, mutex, deadline);
+    if (rval == ETIMEDOUT) {return false; }
+    if (rval) {perror("Timed wait error for condition variable"); exit(1); }
+    return true;
+}
+// -------------------------------------------
+
+// -------------------------------------------
+// read-write lock functions
+void rwlock_init(pthread_rwlock_t* rwlock)
+{
+    int rval = pthread_rwlock_init(rwlock, NULL);
+    if (rval) {perror("Problem initializing rwlock"); exit(1); }
+}
+
+void rwlock_rdlock(pthread_rwlock_t* rwlock)
+{
+    int rval = pthread_rwlock_rdlock(rwlock);
+    if (rval) {perror("Read lock error for rwlock"); exit(1); }
+}
+
+void rwlock_wrlock(pthread_rwlock_t* rwlock)
+{
+    int rval = pthread_rwlock_wrlock(rwlock);
+    if (rval) {perror("Write lock error for rwlock"); exit(1); }
+}
+
+void rwlock_unlock(pthread_rwlock_t* rwlock)
+{
+    int rval = pthread_rwlock_unlock(rwlock);
+    if (rval) {perror("Unlock error for rwlock"); exit(1); }
+}
+// -------------------------------------------
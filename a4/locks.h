@@ -0,0 +1,23 @@
+#ifndef LOCKS_H
+#define LOCKS_H
+
+#include "libraries.h"
+
+// lock function declarations
+void mutex_init(pthread_mutex_t* mutex);
+void mutex_lock(pthread_mutex_t* mutex);
+void mutex_unlock(pthread_mutex_t* mutex);
+
+void cond_init(pthread_cond_t* cond);
+void cond_wait(pthread_cond_t* cond, pthread_mutex_t* mutex);
+void cond_signal(pthread_cond_t* cond);
+void cond_broadcast(pthread_cond_t* cond);
+bool cond_timedwait(pthread_cond_t* cond, pthread_mutex_t* mutex, const struct timespec* deadline);
+
+void rwlock_init(pthread_rwlock_t* rwlock);
+void rwlock_rdlock(pthread_rwlock_t* rwlock);
+void rwlock_wrlock(pthread_rwlock_t* rwlock);
+void rwlock_unlock(pthread_rwlock_t* rwlock);
+// end lock function declarations
+
+#endif
@@ -0,0 +1,701 @@
+#include "manager.h"
+
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <deque>
+#include <set>
+
+#define MANAGER_BACKLOG 64      // connections waiting to be accepted
+#define MANAGER_EVENTS 64       // socket events handled per round of the event loop
+
+long long managerGrants = 0;
+long long managerExpired = 0;
+long long managerDisconnects = 0;
+long long managerClients = 0;
+
+// a request the manager is waiting to grant or has granted
+struct managedRequest
+{
+    resourceRequest request;
+    int client;         // index into clients
+    int requestId;      // picked by the client
+    bool held;
+    bool orphaned;      // its client disconnected while it waited, it is released once granted
+    long long expiry;   // held: msec when the lease runs out
+};
+
+struct managerClient
+{
+    int fd;                     // -1 once disconnected
+    string received;            // bytes that do not make up a whole message yet
+    string toSend;              // replies not written yet
+    bool full;                  // its socket had no room, it is written again once it has
+    int waiting;                // slot of the request waiting in the pool, -1 if none
+    deque<int> queued;          // slots of the requests queued behind it
+    map<int, int> grants;       // request id to slot, for every held grant
+    set<int> requestIds;        // ids of every request queued, waiting or held
+};
+
+deque<managedRequest> slots;            // indexed by the owner passed to grantCallback, the pool
+                                        // keeps pointers to them so they must never move
+vector<int> freeSlots;
+vector<managerClient> clients;
+vector<int> grantedSlots;               // granted by the pool and not handled yet
+set<pair<long long, int> > leases;      // expiry and slot of every held grant
+int managerLeaseMsec = MANAGER_LEASE_MSEC;
+
+// returns the msec since an arbitrary point
+long long managerTimeMsec()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+// creates a listening unix socket at path, returns -1 on failure
+// a socket file left behind by an earlier run is removed first, one a live manager is
+// serving is left alone
+int openManagerSocket(string path)
+{
+    struct sockaddr_un sun;
+    if (path.size() >= sizeof(sun.sun_path))
+    {
+        return -1;
+    }
+    int fd;
+    if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0)) < 0)
+    {
+        return -1;
+    }
+    memset((char *) &sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    strcpy(sun.sun_path, path.c_str());
+
+    // a second manager taking over the path would hand new clients a separate pool
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe >= 0 && connect(probe, (struct sockaddr *) &sun, sizeof(sun)) == 0)
+    {
+        cout << "Another resource manager is serving " << path << endl;
+        close(probe);
+        close(fd);
+        return -1;
+    }
+    if (probe >= 0 && errno == ECONNREFUSED)
+    {
+        // left behind by a manager that is gone
+        unlink(path.c_str());
+    }
+    if (probe >= 0)
+    {
+        close(probe);
+    }
+    if (bind(fd, (struct sockaddr *) &sun, sizeof(sun)) < 0 || listen(fd, MANAGER_BACKLOG) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// -------------------------------------------
+// manager functions
+
+// the pool's grantCallback, the grant is handled once the pool call that made it returns
+void slotGranted(int owner)
+{
+    grantedSlots.push_back(owner);
+}
+
+int allocateSlot()
+{
+    if (freeSlots.empty())
+    {
+        slots.push_back(managedRequest());
+        return slots.size() - 1;
+    }
+    int slot = freeSlots.back();
+    freeSlots.pop_back();
+    return slot;
+}
+
+void queueReply(managerClient &client, int op, int requestId)
+{
+    managerMessage reply;
+    memset(&reply, 0, sizeof(reply));
+    reply.op = op;
+    reply.requestId = requestId;
+    client.toSend.append((const char *) &reply, sizeof(reply));
+}
+
+// puts the next queued request of a client in the pool, until one has to wait
+void admitQueued(managerClient &client)
+{
+    while (client.waiting < 0 && !client.queued.empty())
+    {
+        int slot = client.queued.front();
+        client.queued.pop_front();
+        if (requestResources(slots[slot].request))
+        {
+            slotGranted(slot);
+            return;
+        }
+        client.waiting = slot;
+    }
+}
+
+// gives a granted request to its client, or back to the pool if the client is gone
+void handleGrant(int slot)
+{
+    managedRequest &managed = slots[slot];
+    if (managed.orphaned)
+    {
+        releaseResources(managed.request);
+        freeSlots.push_back(slot);
+        return;
+    }
+    managerClient &client = clients[managed.client];
+    managed.held = true;
+    managed.expiry = managerTimeMsec() + managerLeaseMsec;
+    leases.insert(make_pair(managed.expiry, slot));
+    client.grants[managed.requestId] = slot;
+    managerGrants += 1;
+    queueReply(client, MANAGER_GRANTED, managed.requestId);
+    if (client.waiting == slot)
+    {
+        client.waiting = -1;
+    }
+    admitQueued(client);
+}
+
+// handles the grants made by pool calls until no more are made
+void handleGrants()
+{
+    for (int i = 0; i < grantedSlots.size(); ++i)
+    {
+        handleGrant(grantedSlots[i]);
+    }
+    grantedSlots.clear();
+}
+
+// gives back the resources of a held grant and frees its slot
+void endGrant(int slot)
+{
+    managedRequest &managed = slots[slot];
+    leases.erase(make_pair(managed.expiry, slot));
+    clients[managed.client].grants.erase(managed.requestId);
+    clients[managed.client].requestIds.erase(managed.requestId);
+    managed.held = false;
+    releaseResources(managed.request);
+    freeSlots.push_back(slot);
+}
+
+// queues an acquire behind the client's other requests, an invalid one or one reusing the id of
+// a request that is not released yet is answered with ERROR
+void acquireForClient(int clientIndex, const managerMessage &msg)
+{
+    managerClient &client = clients[clientIndex];
+    bool valid = msg.numResources >= 0 && msg.numResources <= NRES_TYPES && client.requestIds.count(msg.requestId) == 0;
+    int slot = allocateSlot();
+    managedRequest &managed = slots[slot];
+    initRequest(managed.request);
+    for (int i = 0; valid && i < msg.numResources; ++i)
+    {
+        valid = msg.ids[i] >= 0 && msg.ids[i] < resourceNames.size() &&
+                msg.units[i] > 0 && msg.units[i] <= maxResources[msg.ids[i]] &&
+                addNeed(managed.request, msg.ids[i], msg.units[i]);
+    }
+    if (!valid)
+    {
+        freeSlots.push_back(slot);
+        queueReply(client, MANAGER_ERROR, msg.requestId);
+        return;
+    }
+    managed.request.grantCallback = slotGranted;
+    managed.request.owner = slot;
+    managed.client = clientIndex;
+    managed.requestId = msg.requestId;
+    managed.held = false;
+    managed.orphaned = false;
+    client.requestIds.insert(msg.requestId);
+    client.queued.push_back(slot);
+    admitQueued(client);
+}
+
+// carries out one message from a client
+void handleMessage(int clientIndex, const managerMessage &msg)
+{
+    managerClient &client = clients[clientIndex];
+    if (msg.op == MANAGER_HELLO)
+    {
+        for (int id = 0; id < resourceNames.size(); ++id)
+        {
+            managerMessage reply;
+            memset(&reply, 0, sizeof(reply));
+            reply.op = MANAGER_HELLO;
+            reply.requestId = id;
+            reply.numResources = resourceNames.size();
+            reply.units[0] = maxResources[id];
+            reply.units[1] = managerLeaseMsec;
+            strncpy(reply.name, resourceNames[id].c_str(), MANAGER_NAME_LEN - 1);
+            client.toSend.append((const char *) &reply, sizeof(reply));
+        }
+    }
+    else if (msg.op == MANAGER_ACQUIRE)
+    {
+        acquireForClient(clientIndex, msg);
+    }
+    else if ((msg.op == MANAGER_RELEASE || msg.op == MANAGER_RENEW) && client.grants.count(msg.requestId) > 0)
+    {
+        int slot = client.grants[msg.requestId];
+        if (msg.op == MANAGER_RELEASE)
+        {
+            endGrant(slot);
+        }
+        else
+        {
+            managedRequest &managed = slots[slot];
+            leases.erase(make_pair(managed.expiry, slot));
+            managed.expiry = managerTimeMsec() + managerLeaseMsec;
+            leases.insert(make_pair(managed.expiry, slot));
+        }
+    }
+    else
+    {
+        // an unknown message, or a grant that already expired
+        queueReply(client, MANAGER_ERROR, msg.requestId);
+    }
+    handleGrants();
+}
+
+// gives back everything a client held, drops its queued requests and closes its socket
+void disconnectClient(int clientIndex)
+{
+    managerClient &client = clients[clientIndex];
+    while (!client.grants.empty())
+    {
+        endGrant(client.grants.begin()->second);
+    }
+    for (int i = 0; i < client.queued.size(); ++i)
+    {
+        freeSlots.push_back(client.queued[i]);
+    }
+    client.queued.clear();
+    client.requestIds.clear();
+    if (client.waiting >= 0)
+    {
+        // it can not be taken out of the pool's queue, so it is released once granted
+        slots[client.waiting].orphaned = true;
+        client.waiting = -1;
+    }
+    close(client.fd);
+    client.fd = -1;
+    client.received.clear();
+    client.toSend.clear();
+    managerDisconnects += 1;
+    handleGrants();
+}
+
+// takes back the grants whose lease ran out, returns the msec until the next one does, -1 if none
+int expireLeases()
+{
+    long long now = managerTimeMsec();
+    while (!leases.empty() && leases.begin()->first <= now)
+    {
+        int slot = leases.begin()->second;
+        managerClient &client = clients[slots[slot].client];
+        queueReply(client, MANAGER_EXPIRED, slots[slot].requestId);
+        endGrant(slot);
+        managerExpired += 1;
+        handleGrants();
+    }
+    return leases.empty() ? -1 : leases.begin()->first - now;
+}
+
+// reads the messages a client sent and carries them out, returns false if it disconnected
+bool readClient(int clientIndex)
+{
+    static char buf[MANAGER_READ_BUFFER];
+    while (true)
+    {
+        int n = read(clients[clientIndex].fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+        string &received = clients[clientIndex].received;
+        received.append(buf, n);
+        int used = 0;
+        while (received.size() - used >= sizeof(managerMessage))
+        {
+            managerMessage msg;
+            memcpy(&msg, received.data() + used, sizeof(msg));
+            used += sizeof(msg);
+            handleMessage(clientIndex, msg);
+        }
+        received.erase(0, used);
+        if (n < sizeof(buf))
+        {
+            return true;
+        }
+    }
+}
+
+// writes what can be written of a client's replies, returns false if it disconnected
+bool writeClient(int clientIndex)
+{
+    managerClient &client = clients[clientIndex];
+    while (!client.toSend.empty())
+    {
+        int n = send(client.fd, client.toSend.data(), client.toSend.size(), MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        client.toSend.erase(0, n);
+    }
+    return true;
+}
+
+// writes the replies of every client in one write each, a client whose socket is full is
+// written again once it has room
+// returns true if a client disconnected, which can grant requests of clients already written
+bool flushClients(int epollfd)
+{
+    bool disconnected = false;
+    for (int c = 0; c < clients.size(); ++c)
+    {
+        if (clients[c].fd < 0 || (clients[c].toSend.empty() && !clients[c].full))
+        {
+            continue;
+        }
+        if (!writeClient(c))
+        {
+            epoll_ctl(epollfd, EPOLL_CTL_DEL, clients[c].fd, NULL);
+            disconnectClient(c);
+            disconnected = true;
+            continue;
+        }
+        bool full = !clients[c].toSend.empty();
+        if (full != clients[c].full)
+        {
+            struct epoll_event event;
+            event.events = full ? EPOLLIN | EPOLLOUT : EPOLLIN;
+            event.data.u64 = c + 2;
+            epoll_ctl(epollfd, EPOLL_CTL_MOD, clients[c].fd, &event);
+            clients[c].full = full;
+        }
+    }
+    return disconnected;
+}
+
+// serves clients on listenfd until SIGINT or SIGTERM, the resource pool must be initialized in
+// queue mode with its resources added. Returns false if the event loop could not be set up
+bool runManager(int listenfd, int leaseMsec)
+{
+    managerLeaseMsec = leaseMsec;
+    sigset_t stopSignals;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &stopSignals, NULL);
+    int signalfd = ::signalfd(-1, &stopSignals, SFD_NONBLOCK);
+    int epollfd = epoll_create1(0);
+    if (signalfd < 0 || epollfd < 0)
+    {
+        return false;
+    }
+
+    // the event data of a client is its index plus 2, 0 and 1 are the two sockets
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = 0;
+    epoll_ctl(epollfd, EPOLL_CTL_ADD, listenfd, &event);
+    event.data.u64 = 1;
+    epoll_ctl(epollfd, EPOLL_CTL_ADD, signalfd, &event);
+
+    struct epoll_event events[MANAGER_EVENTS];
+    bool stopping = false;
+    while (!stopping)
+    {
+        // the replies of a round, including grants made for other clients' releases, go out
+        // together before waiting for the next requests. Until a pass disconnects nobody, as a
+        // disconnect gives back resources that can be granted to anyone, and the wait ends at
+        // the earliest lease held once they are all written
+        int timeout;
+        do
+        {
+            timeout = expireLeases();
+        } while (flushClients(epollfd));
+        int n = epoll_wait(epollfd, events, MANAGER_EVENTS, timeout);
+        for (int e = 0; e < n; ++e)
+        {
+            if (events[e].data.u64 == 0)
+            {
+                int clientfd;
+                while ((clientfd = accept4(listenfd, NULL, NULL, SOCK_NONBLOCK)) >= 0)
+                {
+                    managerClient client;
+                    client.fd = clientfd;
+                    client.full = false;
+                    client.waiting = -1;
+                    clients.push_back(client);
+                    event.events = EPOLLIN;
+                    event.data.u64 = clients.size() + 1;
+                    epoll_ctl(epollfd, EPOLL_CTL_ADD, clientfd, &event);
+                    managerClients += 1;
+                }
+            }
+            else if (events[e].data.u64 == 1)
+            {
+                stopping = true;
+            }
+            else
+            {
+                int c = events[e].data.u64 - 2;
+                if (clients[c].fd >= 0 && (events[e].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0 && !readClient(c))
+                {
+                    epoll_ctl(epollfd, EPOLL_CTL_DEL, clients[c].fd, NULL);
+                    disconnectClient(c);
+                }
+            }
+        }
+    }
+
+    for (int c = 0; c < clients.size(); ++c)
+    {
+        if (clients[c].fd >= 0)
+        {
+            close(clients[c].fd);
+        }
+    }
+    close(epollfd);
+    close(signalfd);
+    return true;
+}
+// -------------------------------------------
+
+// -------------------------------------------
+// client functions
+
+// connects to the manager at path and finds its id for every resource in resourceNames
+// returns false if it can not be reached or does not have enough of every resource
+bool connectManager(managerConnection &conn, string path)
+{
+    struct sockaddr_un sun;
+    conn.fd = -1;
+    conn.nextRequestId = 0;
+    conn.leaseMsec = MANAGER_LEASE_MSEC;
+    conn.expired = false;
+    conn.received.clear();
+    conn.toSend.clear();
+    if (path.size() >= sizeof(sun.sun_path) || (conn.fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    {
+        return false;
+    }
+    memset((char *) &sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    strcpy(sun.sun_path, path.c_str());
+    if (connect(conn.fd, (struct sockaddr *) &sun, sizeof(sun)) < 0)
+    {
+        closeManager(conn);
+        return false;
+    }
+
+    managerMessage hello;
+    memset(&hello, 0, sizeof(hello));
+    hello.op = MANAGER_HELLO;
+    queueManagerMessage(conn, hello);
+    if (!flushManager(conn))
+    {
+        closeManager(conn);
+        return false;
+    }
+    map<string, pair<int, int> > served; // name to id and units
+    int numServed = -1;
+    managerMessage reply;
+    while (numServed != 0 && readManagerMessage(conn, reply) && reply.op == MANAGER_HELLO)
+    {
+        reply.name[MANAGER_NAME_LEN - 1] = '\0';
+        served[reply.name] = make_pair(reply.requestId, reply.units[0]);
+        conn.leaseMsec = reply.units[1];
+        numServed = (numServed < 0 ? reply.numResources : numServed) - 1;
+    }
+    for (int id = 0; id < resourceNames.size(); ++id)
+    {
+        if (numServed != 0 || served.count(resourceNames[id]) == 0 || served[resourceNames[id]].second < maxResources[id])
+        {
+            closeManager(conn);
+            return false;
+        }
+        conn.remoteIDs[id] = served[resourceNames[id]].first;
+    }
+    return true;
+}
+
+void queueManagerMessage(managerConnection &conn, const managerMessage &msg)
+{
+    conn.toSend.append((const char *) &msg, sizeof(msg));
+}
+
+// queues an acquire of a request and returns the id of the request
+int queueAcquire(managerConnection &conn, const resourceRequest &request)
+{
+    managerMessage msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.op = MANAGER_ACQUIRE;
+    msg.requestId = conn.nextRequestId++;
+    msg.numResources = request.numResources;
+    for (int i = 0; i < request.numResources; ++i)
+    {
+        msg.ids[i] = conn.remoteIDs[request.needs[i].id];
+        msg.units[i] = request.needs[i].total;
+    }
+    queueManagerMessage(conn, msg);
+    return msg.requestId;
+}
+
+void queueRelease(managerConnection &conn, int requestId)
+{
+    managerMessage msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.op = MANAGER_RELEASE;
+    msg.requestId = requestId;
+    queueManagerMessage(conn, msg);
+}
+
+void queueRenew(managerConnection &conn, int requestId)
+{
+    managerMessage msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.op = MANAGER_RENEW;
+    msg.requestId = requestId;
+    queueManagerMessage(conn, msg);
+}
+
+// sends every queued message in one write, returns false if the manager is gone
+bool flushManager(managerConnection &conn)
+{
+    while (!conn.toSend.empty())
+    {
+        int n = send(conn.fd, conn.toSend.data(), conn.toSend.size(), MSG_NOSIGNAL);
+        if (n < 0 && errno != EINTR)
+        {
+            return false;
+        }
+        conn.toSend.erase(0, max(n, 0));
+    }
+    return true;
+}
+
+// blocks until a message from the manager arrives, returns false if the manager is gone
+bool readManagerMessage(managerConnection &conn, managerMessage &msg)
+{
+    char buf[MANAGER_READ_BUFFER];
+    while (conn.received.size() < sizeof(msg))
+    {
+        int n = read(conn.fd, buf, sizeof(buf));
+        if (n == 0 || (n < 0 && errno != EINTR))
+        {
+            return false;
+        }
+        conn.received.append(buf, max(n, 0));
+    }
+    memcpy(&msg, conn.received.data(), sizeof(msg));
+    conn.received.erase(0, sizeof(msg));
+    return true;
+}
+
+// the blocking functions below are for a client with one request at a time: a reply to
+// anything but the request being acquired is an EXPIRED, or an ERROR for a renew or release
+// that came after the grant expired, and either means a grant was lost while it was held
+
+// blocks until the manager grants a request, returns its id or -1 if the manager is gone,
+// refused it or took back an earlier grant, which sets conn.expired
+int managerAcquire(managerConnection &conn, const resourceRequest &request)
+{
+    int requestId = queueAcquire(conn, request);
+    if (!flushManager(conn))
+    {
+        return -1;
+    }
+    managerMessage reply;
+    while (readManagerMessage(conn, reply))
+    {
+        if (reply.requestId == requestId && reply.op == MANAGER_GRANTED)
+        {
+            return requestId;
+        }
+        if (reply.requestId == requestId && reply.op == MANAGER_ERROR)
+        {
+            return -1;
+        }
+        if (reply.op == MANAGER_EXPIRED || reply.op == MANAGER_ERROR)
+        {
+            conn.expired = true;
+            return -1;
+        }
+    }
+    return -1;
+}
+
+// reads the replies that already arrived without blocking, returns false if the manager is gone
+// or took back a grant, which sets conn.expired
+bool checkManagerReplies(managerConnection &conn)
+{
+    char buf[MANAGER_READ_BUFFER];
+    int n;
+    while ((n = recv(conn.fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0 || (n < 0 && errno == EINTR))
+    {
+        conn.received.append(buf, max(n, 0));
+    }
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+    {
+        return false;
+    }
+    managerMessage reply;
+    while (conn.received.size() >= sizeof(reply))
+    {
+        readManagerMessage(conn, reply);
+        if (reply.op == MANAGER_EXPIRED || reply.op == MANAGER_ERROR)
+        {
+            conn.expired = true;
+        }
+    }
+    return !conn.expired;
+}
+
+// extends the lease of a held grant, returns false if the manager is gone or the grant has
+// already been taken back
+bool managerRenew(managerConnection &conn, int requestId)
+{
+    queueRenew(conn, requestId);
+    return flushManager(conn) && checkManagerReplies(conn);
+}
+
+// gives a grant back to the manager, returns false if the manager is gone or the grant had
+// already been taken back. An expiry that is answered after this returns is found by the next
+// managerAcquire
+bool managerRelease(managerConnection &conn, int requestId)
+{
+    queueRelease(conn, requestId);
+    return flushManager(conn) && checkManagerReplies(conn);
+}
+
+void closeManager(managerConnection &conn)
+{
+    if (conn.fd >= 0)
+    {
+        close(conn.fd);
+    }
+    conn.fd = -1;
+}
+// -------------------------------------------
@@ -0,0 +1,91 @@
+#ifndef MANAGER_H
+#define MANAGER_H
+
+#include "libraries.h"
+#include "resources.h"
+
+#define MANAGER_NAME_LEN 32         // longest resource name the manager serves, with its terminator
+#define MANAGER_LEASE_MSEC 10000    // default time a client may hold a grant before it is taken back
+#define MANAGER_READ_BUFFER 65536   // bytes read from a socket at once, a batch of requests
+
+// what a manager message asks for or answers
+enum managerOp {MANAGER_HELLO, MANAGER_ACQUIRE, MANAGER_RELEASE, MANAGER_RENEW,
+                MANAGER_GRANTED, MANAGER_EXPIRED, MANAGER_ERROR};
+
+/* RESOURCE MANAGER
+a4rmd keeps a resource pool for tasks in many processes on the same host. A client connects to
+its unix socket and sends fixed size messages: HELLO, answered with one HELLO per resource
+giving its name and units, then ACQUIRE, RELEASE and RENEW naming a request id the client
+picked. ACQUIRE is answered with GRANTED once all of the resources are held for the client.
+The HELLO replies also carry the lease time, see below. Any number of messages can be sent in
+one write and the replies of a round of the manager's event loop go out in one write per client.
+A request id can not be used again until its request is released or has expired.
+
+Requests are all-or-nothing as in the resource pool of a4tasks, which the manager uses in queue
+mode with the scheduling policy it is started with. Each client has at most one request waiting
+in the pool and the rest of its requests queue behind it, so a client sending many requests at
+once can not take turns from the others.
+
+A grant is a lease: unless the client renews or releases it within the lease time, the
+resources are taken back and the client is sent EXPIRED, and a later RENEW or RELEASE of it is
+answered with ERROR. A client holding a grant longer than the lease renews it in time, as
+a4tasks does every half lease while it is busy. A client that disconnects, or whose
+process dies, gives back everything it held and its waiting requests are dropped.
+*/
+struct managerMessage
+{
+    int op;                         // a managerOp
+    int requestId;                  // HELLO reply: the resource id
+    int numResources;
+    int ids[NRES_TYPES];            // the manager's resource ids
+    int units[NRES_TYPES];          // HELLO reply: units[0] is the units of the resource, units[1]
+                                    // the lease msec
+    char name[MANAGER_NAME_LEN];    // HELLO reply: the resource name
+};
+
+// a client's connection to the manager
+struct managerConnection
+{
+    int fd;
+    int remoteIDs[NRES_TYPES];      // the manager's id of each resource in resourceNames
+    int nextRequestId;
+    int leaseMsec;                  // how long the manager lets a grant be held without a renew
+    bool expired;                   // a grant was taken back while the client still held it
+    string received;                // bytes read that do not make up a whole message yet
+    string toSend;                  // messages queued until the next flush
+};
+
+extern long long managerGrants;         // requests granted by the manager
+extern long long managerExpired;        // grants taken back because their lease ran out
+extern long long managerDisconnects;    // clients that disconnected, with everything they held
+extern long long managerClients;        // clients that connected
+
+// resource manager function declarations
+int openManagerSocket(string path);
+
+bool runManager(int listenfd, int leaseMsec);
+
+bool connectManager(managerConnection &conn, string path);
+
+void queueManagerMessage(managerConnection &conn, const managerMessage &msg);
+
+int queueAcquire(managerConnection &conn, const resourceRequest &request);
+
+void queueRelease(managerConnection &conn, int requestId);
+
+void queueRenew(managerConnection &conn, int requestId);
+
+bool flushManager(managerConnection &conn);
+
+bool readManagerMessage(managerConnection &conn, managerMessage &msg);
+
+int managerAcquire(managerConnection &conn, const resourceRequest &request);
+
+bool managerRenew(managerConnection &conn, int requestId);
+
+bool managerRelease(managerConnection &conn, int requestId);
+
+void closeManager(managerConnection &conn);
+// end resource manager function declarations
+
+#endif
@@ -0,0 +1,232 @@
+#include "metrics.h"
+#include "output.h"
+
+atomic<long long> waitHistogram[MAX_WAIT_MSEC + 1];    // iterations that waited each number of msec
+atomic<long long> starvationEvents(0);
+int starvationThreshold = STARVATION_MSEC;
+
+// the time a task has spent waiting, each task has its own so tasks never write a shared counter
+struct alignas(64) waitingClock
+{
+    atomic<long long> usecTotal;    // minus the start and plus the end of every wait
+    atomic<bool> waiting;
+};
+
+// the run clock and the time weighted number of waiting tasks, see setPoolClock
+long long (*metricsClockUsec)() = NULL;
+long long metricsStartUsec = 0;
+vector<waitingClock> waitingClocks;
+int waitingPeak = 0;                // most waiting tasks in a monitor snapshot
+
+FILE *exportFp = NULL;
+bool exportJSON = false;
+
+// returns true if name ends with suffix
+bool endsWith(string name, string suffix)
+{
+    return name.size() >= suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// resets the metrics, starts the time weighted levels against clockUsec and opens the export
+// file, no file is written if exportFile is empty
+// must be called after the resources are declared, returns false if the file can not be opened
+bool initMetrics(int starvationMsec, string exportFile, long long (*clockUsec)())
+{
+    starvationThreshold = starvationMsec;
+    metricsClockUsec = clockUsec;
+    metricsStartUsec = clockUsec();
+    setPoolClock(clockUsec);
+    if (exportFile.empty())
+    {
+        return true;
+    }
+    if ((exportFp = fopen(exportFile.c_str(), "w")) == NULL)
+    {
+        return false;
+    }
+    exportJSON = endsWith(exportFile, ".json");
+    if (!exportJSON)
+    {
+        fprintf(exportFp, "time_msec,waiting,running,idle,queued,grants,starvation_events,p50_wait_msec,p95_wait_msec,p99_wait_msec");
+        for (int id = 0; id < resourceNames.size(); ++id)
+        {
+            fprintf(exportFp, ",%s_held,%s_utilization", resourceNames[id].c_str(), resourceNames[id].c_str());
+        }
+        fprintf(exportFp, "\n");
+    }
+    return true;
+}
+
+// records the wait of one iteration, returns true if it was long enough to count as starvation
+bool recordWait(long long waitMsec)
+{
+    waitHistogram[min(waitMsec, (long long) MAX_WAIT_MSEC)].fetch_add(1, memory_order_relaxed);
+    if (waitMsec > starvationThreshold)
+    {
+        starvationEvents.fetch_add(1, memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+// sets up the waiting clocks of up to numTasks tasks, none of them waiting until it records so
+// must be called before any task is created, the clocks are never reallocated
+void initWaitingClocks(int numTasks)
+{
+    waitingClocks = vector<waitingClock>(numTasks);
+    for (int i = 0; i < numTasks; ++i)
+    {
+        waitingClocks[i].usecTotal.store(0, memory_order_relaxed);
+        waitingClocks[i].waiting.store(false, memory_order_relaxed);
+    }
+}
+
+// records that a task started or stopped waiting for resources
+// only the task itself calls this once it has started, so the clock is never written concurrently
+void recordWaitingChange(int taskIndex, bool waiting)
+{
+    waitingClock &clock = waitingClocks[taskIndex];
+    long long now = metricsClockUsec();
+    clock.usecTotal.store(clock.usecTotal.load(memory_order_relaxed) + (waiting ? -now : now), memory_order_relaxed);
+    clock.waiting.store(waiting, memory_order_relaxed);
+}
+
+// returns the number of waits recorded
+long long waitCount()
+{
+    long long count = 0;
+    for (int msec = 0; msec <= MAX_WAIT_MSEC; ++msec)
+    {
+        count += waitHistogram[msec].load(memory_order_relaxed);
+    }
+    return count;
+}
+
+// returns the smallest wait that at least fraction of the recorded waits did not exceed
+long long waitPercentile(double fraction)
+{
+    long long count = waitCount();
+    long long seen = 0;
+    for (int msec = 0; msec <= MAX_WAIT_MSEC; ++msec)
+    {
+        seen += waitHistogram[msec].load(memory_order_relaxed);
+        if (seen > 0 && seen >= fraction * count)
+        {
+            return msec;
+        }
+    }
+    return 0;
+}
+
+// samples the resource pool and the task states, and appends the sample to the export file
+// called by the monitor, timeMsec is the time since the program started
+void sampleMetrics(long long timeMsec, int waiting, int running, int idle)
+{
+    waitingPeak = max(waitingPeak, waiting);
+    if (exportFp == NULL)
+    {
+        return;
+    }
+    int held[NRES_TYPES];
+    heldUnits(held);
+    int queued = queuedRequests();
+    long long grants = waitCount();
+    long long p50 = waitPercentile(0.50), p95 = waitPercentile(0.95), p99 = waitPercentile(0.99);
+    if (exportJSON)
+    {
+        fprintf(exportFp, "{\"time_msec\": %lld, \"tasks\": {\"waiting\": %d, \"running\": %d, \"idle\": %d}, "
+                          "\"queued\": %d, \"grants\": %lld, \"starvation_events\": %lld, "
+                          "\"wait_msec\": {\"p50\": %lld, \"p95\": %lld, \"p99\": %lld}, \"resources\": {",
+                timeMsec, waiting, running, idle, queued, grants, starvationEvents.load(), p50, p95, p99);
+        for (int id = 0; id < resourceNames.size(); ++id)
+        {
+            fprintf(exportFp, "%s\"%s\": {\"held\": %d, \"max\": %d, \"utilization\": %.3f}", id > 0 ? ", " : "",
+                    resourceNames[id].c_str(), held[id], maxResources[id], (double) held[id] / max(1, maxResources[id]));
+        }
+        fprintf(exportFp, "}}\n");
+    }
+    else
+    {
+        fprintf(exportFp, "%lld,%d,%d,%d,%d,%lld,%lld,%lld,%lld,%lld", timeMsec, waiting, running, idle, queued,
+                grants, starvationEvents.load(), p50, p95, p99);
+        for (int id = 0; id < resourceNames.size(); ++id)
+        {
+            fprintf(exportFp, ",%d,%.3f", held[id], (double) held[id] / max(1, maxResources[id]));
+        }
+        fprintf(exportFp, "\n");
+    }
+}
+
+// prints the wait histogram, the utilization of each resource, the queue lengths and the
+// starvation events, starvedTasks is the number of tasks that starved at least once
+void printMetricsReport(int starvedTasks)
+{
+    ostringstream out;
+    out << fixed << setprecision(1);
+    out << endl << "Wait histogram (msec per iteration):" << endl;
+    long long buckets[WAIT_BUCKETS] = {0};
+    for (int msec = 0; msec <= MAX_WAIT_MSEC; ++msec)
+    {
+        int bucket = 0;
+        while (bucket < WAIT_BUCKETS - 1 && (1 << bucket) <= msec)
+        {
+            bucket += 1;
+        }
+        buckets[bucket] += waitHistogram[msec].load();
+    }
+    for (int i = 0; i < WAIT_BUCKETS; ++i)
+    {
+        if (buckets[i] == 0)
+        {
+            continue;
+        }
+        ostringstream range;
+        if (i == 0)
+        {
+            range << "0";
+        }
+        else if (i == WAIT_BUCKETS - 1)
+        {
+            range << (1 << (i - 1)) << "+";
+        }
+        else
+        {
+            range << (1 << (i - 1)) << "-" << (1 << i) - 1;
+        }
+        out << "       " << setw(12) << range.str() << ": " << buckets[i] << endl;
+    }
+
+    // the integrals of the levels over the run divided by its length
+    long long now = metricsClockUsec();
+    long long runUsec = now - metricsStartUsec;
+    long long heldUsec[NRES_TYPES];
+    long long queuedUsec;
+    poolLevelUsec(heldUsec, queuedUsec);
+    long long waitingUsec = 0;
+    for (int i = 0; i < waitingClocks.size(); ++i)
+    {
+        waitingUsec += waitingClocks[i].usecTotal.load() + (waitingClocks[i].waiting.load() ? now : 0);
+    }
+    out << "Resource utilization (time weighted over " << runUsec / 1000 << " msec):" << endl;
+    for (int id = 0; id < resourceNames.size(); ++id)
+    {
+        double mean = runUsec > 0 ? (double) heldUsec[id] / runUsec : 0;
+        out << "       " << resourceNames[id] << ": (mean held= " << mean << " of " << maxResources[id] <<
+               ", " << 100.0 * mean / max(1, maxResources[id]) << "%, peak held= " << heldPeak(id) << ")" << endl;
+    }
+    out << "Waiting tasks: mean= " << (runUsec > 0 ? (double) waitingUsec / runUsec : 0) << ", peak= " << waitingPeak <<
+           "; queued requests: mean= " << (runUsec > 0 ? (double) queuedUsec / runUsec : 0) << ", peak= " << queuedPeak() << endl;
+    out << "Starvation events= " << starvationEvents.load() << " (waits over " << starvationThreshold <<
+           " msec), tasks starved= " << starvedTasks << endl;
+    writeOutput(out.str());
+}
+
+// closes the export file
+void closeMetrics()
+{
+    if (exportFp != NULL)
+    {
+        fclose(exportFp);
+        exportFp = NULL;
+    }
+}
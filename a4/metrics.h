@@ -0,0 +1,52 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "libraries.h"
+#include "resources.h"
+
+#include <atomic>
+
+#define MAX_WAIT_MSEC 100000    // longer waits are counted in the last msec of the wait histogram
+#define WAIT_BUCKETS 18         // power of two msec buckets the wait histogram is reported in
+#define STARVATION_MSEC 1000    // default wait of a single iteration counted as a starvation event
+
+/* METRICS
+Every iteration records how long it waited for its resources in a histogram with one counter
+per msec, so percentiles are exact. A wait over the starvation threshold is also counted as a
+starvation event.
+
+The mean and peak utilization of each resource and the mean and peak queue lengths in the final
+report are time weighted over the run: the resource pool records every change of the units held
+and of the requests queued against the run clock, see setPoolClock, and each task records on its
+own clock every time it starts or stops waiting. A run shorter than the monitor period is
+measured as exactly as a long one. The peak number of waiting tasks is the most seen in a
+monitor snapshot.
+
+Every monitor period a sample is taken of the units held of each resource, the number of tasks
+in each state and the number of requests queued in the resource pool, and appended to the
+export file if there is one: a .json file gets one JSON object per line, anything else a CSV
+row. The report shows the wait histogram in power of two buckets:
+bucket 0 counts waits of 0 msec and bucket i waits in [2^(i-1), 2^i) msec.
+*/
+
+// metrics function declarations
+bool initMetrics(int starvationMsec, string exportFile, long long (*clockUsec)());
+
+void initWaitingClocks(int numTasks);
+
+void recordWaitingChange(int taskIndex, bool waiting);
+
+bool recordWait(long long waitMsec);
+
+long long waitCount();
+
+long long waitPercentile(double fraction);
+
+void sampleMetrics(long long timeMsec, int waiting, int running, int idle);
+
+void printMetricsReport(int starvedTasks);
+
+void closeMetrics();
+// end metrics function declarations
+
+#endif
@@ -0,0 +1,123 @@
+#include "output.h"
+#include "locks.h"
+
+pthread_mutex_t outputMutex;
+pthread_cond_t outputCond;      // signalled when the buffer reaches OUTPUT_BATCH bytes or the writer is stopped
+string pendingOutput;           // output not yet taken by the writer thread
+bool outputStopping = false;
+atomic<bool> outputStarted(false);
+long long droppedMessages = 0;
+pthread_t writerTid;
+
+// writes all of data to fd, retrying short writes
+void writeAll(int fd, const char *data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t written = write(fd, data, length);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return;
+        }
+        data += written;
+        length -= written;
+    }
+}
+
+// the writer thread, takes the whole buffer at once and writes it without holding the mutex
+void *outputWriterThread(void *arg)
+{
+    string writing;
+    mutex_lock(&outputMutex);
+    while (true)
+    {
+        if (pendingOutput.size() < OUTPUT_BATCH && !outputStopping)
+        {
+            // wait for a full batch or the flush period
+            struct timeval now;
+            gettimeofday(&now, NULL);
+            long long due = now.tv_sec * 1000000LL + now.tv_usec + OUTPUT_FLUSH_MSEC * 1000;
+            struct timespec deadline;
+            deadline.tv_sec = due / 1000000;
+            deadline.tv_nsec = (due % 1000000) * 1000;
+            cond_timedwait(&outputCond, &outputMutex, &deadline);
+        }
+        if (pendingOutput.empty())
+        {
+            if (outputStopping)
+            {
+                // stopped and everything has been written
+                break;
+            }
+            continue;
+        }
+        writing.swap(pendingOutput);
+        mutex_unlock(&outputMutex);
+        writeAll(STDOUT_FILENO, writing.data(), writing.size());
+        writing.clear();
+        mutex_lock(&outputMutex);
+    }
+    mutex_unlock(&outputMutex);
+    return NULL;
+}
+
+// starts the writer thread, output written before this goes straight to stdout
+void startOutputWriter()
+{
+    mutex_init(&outputMutex);
+    cond_init(&outputCond);
+    int rval = pthread_create(&writerTid, NULL, outputWriterThread, NULL);
+    if (rval) {perror("Error creating output writer thread"); exit(1); }
+    outputStarted = true;
+}
+
+// queues text to be written to stdout
+void writeOutput(const string &text)
+{
+    if (!outputStarted)
+    {
+        writeAll(STDOUT_FILENO, text.data(), text.size());
+        return;
+    }
+    mutex_lock(&outputMutex);
+    if (pendingOutput.size() + text.size() > OUTPUT_BUFFER_LIMIT)
+    {
+        droppedMessages += 1;
+    }
+    else
+    {
+        bool batchFull = (pendingOutput.size() < OUTPUT_BATCH && pendingOutput.size() + text.size() >= OUTPUT_BATCH);
+        pendingOutput += text;
+        if (batchFull)
+        {
+            cond_signal(&outputCond);
+        }
+    }
+    mutex_unlock(&outputMutex);
+}
+
+// writes everything still buffered and stops the writer thread
+void stopOutputWriter()
+{
+    if (!outputStarted)
+    {
+        return;
+    }
+    mutex_lock(&outputMutex);
+    outputStopping = true;
+    cond_signal(&outputCond);
+    mutex_unlock(&outputMutex);
+    pthread_join(writerTid, NULL);
+    outputStarted = false;
+
+    if (droppedMessages > 0)
+    {
+        ostringstream out;
+        out << "Output fell behind, " << droppedMessages << " messages dropped" << endl;
+        writeOutput(out.str());
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include "libraries.h"
+
+#include <atomic>
+
+// most bytes waiting to be written before new output is dropped
+#define OUTPUT_BUFFER_LIMIT (64 * 1024 * 1024)
+// bytes waiting that wake the writer thread, less is written at the next flush period
+#define OUTPUT_BATCH 65536
+#define OUTPUT_FLUSH_MSEC 10
+
+/* OUTPUT WRITER
+All output of the program is appended to a buffer in memory and written to stdout by a writer
+thread, so the tasks and the monitor never wait for the console. The buffer mutex is only held
+long enough to copy a message in, and the writer is woken once per OUTPUT_BATCH bytes rather
+than for every message, so output is at most OUTPUT_FLUSH_MSEC late. If the console falls OUTPUT_BUFFER_LIMIT bytes behind, new
+messages are dropped and counted instead of making the program wait.
+*/
+
+// output function declarations
+void startOutputWriter();
+
+void writeOutput(const string &text);
+
+void stopOutputWriter();
+// end output function declarations
+
+#endif
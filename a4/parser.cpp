@@ -0,0 +1,296 @@
+#include "parser.h"
+
+#include <string.h>
+#include <limits.h>
+#include <algorithm>
+
+#define MAXWORDS (NRES_TYPES + 5) // one more than the longest valid line has, to catch longer ones
+
+// a word of a line, pointing into the line
+struct word
+{
+    const char *start;
+    int length;
+};
+
+// the state of a parse, kept across lines
+struct parseState
+{
+    string fileName;
+    inputSpec *input;
+    int line;
+    string error;
+};
+
+// records the first problem found, returns false so callers can return it
+bool parseError(parseState &state, string message)
+{
+    if (state.error.empty())
+    {
+        state.error = state.fileName + ":" + to_string(state.line) + ": " + message;
+    }
+    return false;
+}
+
+bool isBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// splits a line into words, returns the number of words, which is MAXWORDS if there are more
+int splitWords(const char *start, const char *end, word words[MAXWORDS])
+{
+    int count = 0;
+    const char *p = start;
+    while (count < MAXWORDS)
+    {
+        while (p < end && isBlank(*p))
+        {
+            p++;
+        }
+        if (p == end)
+        {
+            break;
+        }
+        words[count].start = p;
+        while (p < end && !isBlank(*p))
+        {
+            p++;
+        }
+        words[count].length = p - words[count].start;
+        count += 1;
+    }
+    return count;
+}
+
+bool wordIs(const word &w, const char *text)
+{
+    return w.length == strlen(text) && memcmp(w.start, text, w.length) == 0;
+}
+
+string wordText(const word &w)
+{
+    return string(w.start, w.length);
+}
+
+// reads a whole non-negative number, returns false if the text is anything else
+bool parseNumber(const char *start, int length, int &value)
+{
+    if (length == 0)
+    {
+        return false;
+    }
+    long long number = 0;
+    for (int i = 0; i < length; ++i)
+    {
+        if (start[i] < '0' || start[i] > '9')
+        {
+            return false;
+        }
+        number = number * 10 + (start[i] - '0');
+        if (number > INT_MAX)
+        {
+            return false;
+        }
+    }
+    value = number;
+    return true;
+}
+
+// splits a name:units word, returns false if it is not one
+bool parseNamedUnits(const word &w, word &name, int &units)
+{
+    const char *colon = (const char *) memchr(w.start, ':', w.length);
+    if (colon == NULL || colon == w.start)
+    {
+        return false;
+    }
+    name.start = w.start;
+    name.length = colon - w.start;
+    return parseNumber(colon + 1, w.start + w.length - colon - 1, units);
+}
+
+// returns the id of a declared resource, -1 if it was not declared
+int findResource(const inputSpec &input, const word &name)
+{
+    for (int id = 0; id < input.resourceNames.size(); ++id)
+    {
+        const string &declared = input.resourceNames[id];
+        if (declared.size() == name.length && memcmp(declared.data(), name.start, name.length) == 0)
+        {
+            return id;
+        }
+    }
+    return -1;
+}
+
+bool parseResources(parseState &state, word words[], int count)
+{
+    inputSpec &input = *state.input;
+    if (!input.resourceNames.empty())
+    {
+        return parseError(state, "two resources lines");
+    }
+    if (count == MAXWORDS || count - 1 > NRES_TYPES)
+    {
+        return parseError(state, "more than " + to_string(NRES_TYPES) + " resources");
+    }
+    map<string, int> declared;
+    for (int i = 1; i < count; ++i)
+    {
+        word name;
+        int units;
+        if (!parseNamedUnits(words[i], name, units))
+        {
+            return parseError(state, "expected name:units, found " + wordText(words[i]));
+        }
+        if (!declared.insert(make_pair(wordText(name), units)).second)
+        {
+            return parseError(state, "resource " + wordText(name) + " declared twice");
+        }
+    }
+    if (declared.empty())
+    {
+        return parseError(state, "no resources on the resources line");
+    }
+    // ids in name order
+    for (map<string, int>::iterator it = declared.begin(); it != declared.end(); ++it)
+    {
+        input.resourceNames.push_back(it->first);
+        input.resourceUnits.push_back(it->second);
+    }
+    return true;
+}
+
+bool parseTask(parseState &state, word words[], int count)
+{
+    inputSpec &input = *state.input;
+    if (input.resourceNames.empty())
+    {
+        return parseError(state, "task before the resources line");
+    }
+    if (count < 4)
+    {
+        return parseError(state, "expected task name busyTime idleTime name:units...");
+    }
+    if (count == MAXWORDS || count - 4 > NRES_TYPES)
+    {
+        return parseError(state, "task " + wordText(words[1]) + " lists more than " + to_string(NRES_TYPES) + " resources");
+    }
+    input.tasks.push_back(taskSpec());
+    taskSpec &task = input.tasks.back();
+    task.name = wordText(words[1]);
+    task.line = state.line;
+    task.numNeeds = 0;
+    if (!parseNumber(words[2].start, words[2].length, task.busyTime) ||
+        !parseNumber(words[3].start, words[3].length, task.idleTime))
+    {
+        return parseError(state, "task " + task.name + " has a busy or idle time that is not a number of msec");
+    }
+    for (int i = 4; i < count; ++i)
+    {
+        word name;
+        int units;
+        if (!parseNamedUnits(words[i], name, units))
+        {
+            return parseError(state, "expected name:units, found " + wordText(words[i]));
+        }
+        int id = findResource(input, name);
+        if (id < 0)
+        {
+            return parseError(state, "task " + task.name + " needs resource " + wordText(name) + " which is not declared");
+        }
+        if (units > input.resourceUnits[id])
+        {
+            return parseError(state, "task " + task.name + " needs more of resource " + wordText(name) + " than exist");
+        }
+        if (find(task.needIDs, task.needIDs + task.numNeeds, id) != task.needIDs + task.numNeeds)
+        {
+            return parseError(state, "task " + task.name + " lists resource " + wordText(name) + " twice");
+        }
+        task.needIDs[task.numNeeds] = id;
+        task.needUnits[task.numNeeds] = units;
+        task.numNeeds += 1;
+    }
+    return true;
+}
+
+// parses one line, without its newline
+bool parseLine(parseState &state, const char *start, const char *end)
+{
+    word words[MAXWORDS];
+    int count = splitWords(start, end, words);
+    if (count == 0 || words[0].start[0] == '#')
+    {
+        // comment line or a blank line
+        return true;
+    }
+    if (wordIs(words[0], "resources"))
+    {
+        return parseResources(state, words, count);
+    }
+    if (wordIs(words[0], "task"))
+    {
+        return parseTask(state, words, count);
+    }
+    return parseError(state, "expected a resources or task line, found " + wordText(words[0]));
+}
+
+// reads and checks a whole input file into input
+// returns false and sets error to the first problem, with its line number, if it is not valid
+bool parseInput(string fileName, inputSpec &input, string &error)
+{
+    FILE *fp;
+    if ((fp = fopen(fileName.c_str(), "r")) == NULL)
+    {
+        error = "Provided input file is invalid: " + fileName;
+        return false;
+    }
+    parseState state;
+    state.fileName = fileName;
+    state.input = &input;
+    state.line = 1;
+
+    static char buf[PARSE_CHUNK];
+    string partial;     // the start of a line that continues in the next block
+    bool valid = true;
+    int n;
+    while (valid && (n = fread(buf, 1, sizeof(buf), fp)) > 0)
+    {
+        const char *p = buf;
+        const char *end = buf + n;
+        const char *newline;
+        while (valid && (newline = (const char *) memchr(p, '\n', end - p)) != NULL)
+        {
+            if (partial.empty())
+            {
+                valid = parseLine(state, p, newline);
+            }
+            else
+            {
+                partial.append(p, newline - p);
+                valid = parseLine(state, partial.data(), partial.data() + partial.size());
+                partial.clear();
+            }
+            state.line += 1;
+            p = newline + 1;
+        }
+        partial.append(p, end - p);
+    }
+    if (valid && !partial.empty())
+    {
+        // the last line has no newline
+        valid = parseLine(state, partial.data(), partial.data() + partial.size());
+    }
+    if (valid && ferror(fp))
+    {
+        valid = parseError(state, "read error");
+    }
+    if (valid && input.resourceNames.empty())
+    {
+        valid = parseError(state, "no resources line");
+    }
+    fclose(fp);
+    error = state.error;
+    return valid;
+}
@@ -0,0 +1,43 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+#include "libraries.h"
+#include "resources.h"
+
+#define PARSE_CHUNK 65536   // bytes of the input file read at once
+
+// a task line of the input file
+struct taskSpec
+{
+    string name;
+    int busyTime;
+    int idleTime;
+    int numNeeds;
+    int needIDs[NRES_TYPES];    // ids of the resources in the input's resourceNames
+    int needUnits[NRES_TYPES];
+    int line;                   // line number in the input file
+};
+
+// everything an input file declares
+struct inputSpec
+{
+    vector<string> resourceNames;   // in name order, the order addResource gives them ids in
+    vector<int> resourceUnits;
+    vector<taskSpec> tasks;
+};
+
+/* INPUT PARSER
+The input file is read in PARSE_CHUNK blocks and split into lines and words in place, so a line
+of any length is handled and the only allocations are for the task names and the task list.
+Only a line split across two blocks is copied. The whole file is checked before anything is
+started: a resources line before any task, no resource declared twice, at most NRES_TYPES
+resources in the file and in each task, times and units that are whole numbers, and tasks that
+only need declared resources, each once and no more than exist. The first problem is reported
+as "file:line: message".
+*/
+
+// parser function declarations
+bool parseInput(string fileName, inputSpec &input, string &error);
+// end parser function declarations
+
+#endif
@@ -0,0 +1,119 @@
+/*
+Contention benchmark for the a4tasks resource pool.
+
+Threads repeatedly acquire and release a request with no busy or idle time between them,
+for each wait mode, workload and thread count, and the grants per second are reported.
+
+disjoint:    thread i needs R<i>:1, no two threads share a resource
+overlapping: thread i needs R<i>:1 and S:1, S has one unit for every two threads
+
+usage: resbench [msecPerRun]
+*/
+
+#include "libraries.h"
+#include "locks.h"
+#include "resources.h"
+
+// thread counts measured by the benchmark
+const int THREADCOUNTS[4] = {1, 2, 4, 8};
+
+enum workload {DISJOINT, OVERLAPPING};
+const string WORKLOADNAME[2] = {"disjoint", "overlapping"};
+
+struct benchThread
+{
+    pthread_t tid;
+    resourceRequest request;
+    long long grants;
+};
+
+atomic<bool> stopBenchmark;
+
+// acquires and releases the thread's request until the benchmark is stopped
+void *benchmarkThread(void *arg)
+{
+    benchThread *thread = (benchThread *) arg;
+    while (!stopBenchmark.load(memory_order_relaxed))
+    {
+        acquireResources(thread->request);
+        releaseResources(thread->request);
+        thread->grants += 1;
+    }
+    pthread_exit(NULL);
+}
+
+// runs one configuration and returns the grants per second
+double runBenchmark(waitMode mode, workload load, int numThreads, int msec)
+{
+    initResourcePool(mode, FIRSTFIT);
+    int privateIDs[8];
+    for (int i = 0; i < numThreads; ++i)
+    {
+        ostringstream name;
+        name << "R" << i;
+        privateIDs[i] = addResource(name.str(), 1);
+    }
+    int sharedID = addResource("S", max(1, numThreads / 2));
+
+    benchThread threads[8];
+    for (int i = 0; i < numThreads; ++i)
+    {
+        initRequest(threads[i].request);
+        addNeed(threads[i].request, privateIDs[i], 1);
+        if (load == OVERLAPPING)
+        {
+            addNeed(threads[i].request, sharedID, 1);
+        }
+        threads[i].grants = 0;
+    }
+
+    struct timeval start, end;
+    stopBenchmark.store(false);
+    gettimeofday(&start, NULL);
+    for (int i = 0; i < numThreads; ++i)
+    {
+        if (pthread_create(&threads[i].tid, NULL, benchmarkThread, (void *) &threads[i]))
+        {
+            perror("Error creating benchmark thread");
+            exit(1);
+        }
+    }
+    usleep(msec * 1000);
+    stopBenchmark.store(true);
+
+    long long grants = 0;
+    for (int i = 0; i < numThreads; ++i)
+    {
+        pthread_join(threads[i].tid, NULL);
+        grants += threads[i].grants;
+    }
+    gettimeofday(&end, NULL);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+    return grants / seconds;
+}
+
+int main(int argc, char *argv[])
+{
+    int msec = 500;
+    if (argc == 2)
+    {
+        msec = atoi(argv[1]);
+    }
+
+    cout << "Measuring " << msec << " msec per run on " << sysconf(_SC_NPROCESSORS_ONLN) << " cpus" << endl << endl;
+    cout << "mode     workload     threads   grants/sec" << endl;
+
+    // poll is left out, its 10 msec retry sleep would dominate the measurement
+    for (int mode = QUEUE; mode <= ATOMIC; ++mode)
+    {
+        for (int load = DISJOINT; load <= OVERLAPPING; ++load)
+        {
+            for (int t = 0; t < 4; ++t)
+            {
+                double rate = runBenchmark((waitMode) mode, (workload) load, THREADCOUNTS[t], msec);
+                printf("%-8s %-12s %7d %12.0f\n", WAITMODENAME[mode].c_str(), WORKLOADNAME[load].c_str(), THREADCOUNTS[t], rate);
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,925 @@
+#include "resources.h"
+#include "locks.h"
+
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+vector<string> resourceNames;
+int maxResources[NRES_TYPES];
+waitMode resourceWaitMode = QUEUE;
+schedulePolicy resourcePolicy = FIRSTFIT;
+long long resourceMutexHoldNsec = 0;
+long long resourceMutexHolds = 0;
+long long deadlocksResolved = 0;
+long long unitsRolledBack = 0;
+
+// poll and queue pool
+int availableResources[NRES_TYPES];     // units of each resource in the resource pool
+// queue: waiting requests linked through prevWaiting and nextWaiting
+struct waitList
+{
+    resourceRequest *head;
+    resourceRequest *tail;
+};
+waitList blockedOn[NRES_TYPES]; // queue: waiting requests, listed under a resource they are short of, in arrival order
+atomic<int> queuedCount(0);     // queue: requests waiting in the wait lists or the scheduler
+pthread_mutex_t resourceMutex;
+
+// incremental pool
+vector<resourceRequest *> partialHolders;   // waiting requests that hold units
+bool holdingsChanged = false;   // a waiting request took units since the last deadlock check
+long long incrementalArrivals = 0;  // order the requests started waiting in, the youngest is rolled back
+
+// atomic pool, each resource on its own cache line
+struct alignas(64) atomicResource
+{
+    atomic<int> units;      // units in the resource pool
+    atomic<int> epoch;      // futex word, changed by every release of the resource
+    atomic<int> waiters;    // tasks sleeping on epoch
+};
+atomicResource atomicResources[NRES_TYPES];
+
+// time weighted levels, see setPoolClock
+long long (*poolClockUsec)() = NULL;
+atomic<long long> heldUsecTotal[NRES_TYPES];
+atomic<long long> queuedUsecTotal(0);
+atomic<int> heldPeakUnits[NRES_TYPES];
+atomic<int> queuedPeakCount(0);
+
+// -------------------------------------------
+// resource mutex functions, these record how long the mutex is held
+// returns the time from start in nanoseconds
+long long elapsedNsec(struct timespec start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start.tv_sec) * 1000000000LL + (now.tv_nsec - start.tv_nsec);
+}
+
+void lockResources(struct timespec* lockedAt)
+{
+    mutex_lock(&resourceMutex);
+    clock_gettime(CLOCK_MONOTONIC, lockedAt);
+}
+
+// must be called with the resource mutex held
+void recordResourceHold(struct timespec* lockedAt)
+{
+    resourceMutexHoldNsec += elapsedNsec(*lockedAt);
+    resourceMutexHolds += 1;
+}
+
+void unlockResources(struct timespec* lockedAt)
+{
+    recordResourceHold(lockedAt);
+    mutex_unlock(&resourceMutex);
+}
+// -------------------------------------------
+
+// -------------------------------------------
+// level functions, these keep the time weighted totals once a clock is set
+void atomicMax(atomic<int> &peak, int value)
+{
+    int seen = peak.load(memory_order_relaxed);
+    while (value > seen && !peak.compare_exchange_weak(seen, value, memory_order_relaxed))
+    {
+    }
+}
+
+// records that the units held of a resource changed by delta to held
+void noteHeld(int id, int delta, int held)
+{
+    if (poolClockUsec == NULL || delta == 0)
+    {
+        return;
+    }
+    heldUsecTotal[id].fetch_add(-delta * poolClockUsec(), memory_order_relaxed);
+    atomicMax(heldPeakUnits[id], held);
+}
+
+// changes the number of queued requests by delta
+void changeQueued(int delta)
+{
+    int queued = queuedCount.fetch_add(delta) + delta;
+    if (poolClockUsec == NULL)
+    {
+        return;
+    }
+    queuedUsecTotal.fetch_add(-delta * poolClockUsec(), memory_order_relaxed);
+    atomicMax(queuedPeakCount, queued);
+}
+// -------------------------------------------
+
+// -------------------------------------------
+// futex functions
+void futexWait(atomic<int> *word, int expected)
+{
+    syscall(SYS_futex, (int *) word, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+void futexWakeAll(atomic<int> *word)
+{
+    syscall(SYS_futex, (int *) word, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+// -------------------------------------------
+
+// empties the resource pool and selects how tasks wait for resources and which are granted them
+void initResourcePool(waitMode mode, schedulePolicy policy)
+{
+    resourceWaitMode = mode;
+    resourcePolicy = policy;
+    initScheduler(policy);
+    resourceNames.clear();
+    for (int id = 0; id < NRES_TYPES; ++id)
+    {
+        blockedOn[id].head = NULL;
+        blockedOn[id].tail = NULL;
+    }
+    queuedCount = 0;
+    resourceMutexHoldNsec = 0;
+    resourceMutexHolds = 0;
+    partialHolders.clear();
+    holdingsChanged = false;
+    incrementalArrivals = 0;
+    deadlocksResolved = 0;
+    unitsRolledBack = 0;
+    poolClockUsec = NULL;
+    queuedUsecTotal = 0;
+    queuedPeakCount = 0;
+    mutex_init(&resourceMutex);
+}
+
+// adds a resource to the pool and returns its id
+int addResource(string name, int units)
+{
+    int id = resourceNames.size();
+    resourceNames.push_back(name);
+    maxResources[id] = units;
+    availableResources[id] = units;
+    atomicResources[id].units.store(units);
+    atomicResources[id].epoch.store(0);
+    atomicResources[id].waiters.store(0);
+    heldUsecTotal[id] = 0;
+    heldPeakUnits[id] = 0;
+    return id;
+}
+
+// returns the units of a resource that are not held by any task
+int availableUnits(int id)
+{
+    if (resourceWaitMode == ATOMIC)
+    {
+        return atomicResources[id].units.load();
+    }
+    return availableResources[id];
+}
+
+// fills held with the units of each resource held by tasks, taken at a single moment
+void heldUnits(int held[NRES_TYPES])
+{
+    if (resourceWaitMode == ATOMIC)
+    {
+        for (int id = 0; id < resourceNames.size(); ++id)
+        {
+            held[id] = maxResources[id] - atomicResources[id].units.load();
+        }
+        return;
+    }
+    struct timespec lockedAt;
+    lockResources(&lockedAt);
+    for (int id = 0; id < resourceNames.size(); ++id)
+    {
+        held[id] = maxResources[id] - availableResources[id];
+    }
+    unlockResources(&lockedAt);
+}
+
+// returns the number of requests waiting in the queue to be granted
+int queuedRequests()
+{
+    return queuedCount.load();
+}
+
+// starts recording the time weighted levels against clockUsec, which is read on every change
+// must be called before any task asks for resources
+void setPoolClock(long long (*clockUsec)())
+{
+    poolClockUsec = clockUsec;
+}
+
+// fills heldUsec with the integral of the units held of each resource over time and sets
+// queuedUsec to that of the queued requests, both up to now in unit usec
+void poolLevelUsec(long long heldUsec[NRES_TYPES], long long &queuedUsec)
+{
+    long long now = poolClockUsec != NULL ? poolClockUsec() : 0;
+    int held[NRES_TYPES];
+    heldUnits(held);
+    for (int id = 0; id < resourceNames.size(); ++id)
+    {
+        heldUsec[id] = heldUsecTotal[id].load() + held[id] * now;
+    }
+    queuedUsec = queuedUsecTotal.load() + queuedCount.load() * now;
+}
+
+// returns the most units of a resource held at once since the clock was set
+int heldPeak(int id)
+{
+    return heldPeakUnits[id].load();
+}
+
+// returns the most requests queued at once since the clock was set
+int queuedPeak()
+{
+    return queuedPeakCount.load();
+}
+
+// creates an empty request
+void initRequest(resourceRequest &request)
+{
+    request.numResources = 0;
+    request.granted = false;
+    request.grantCallback = NULL;
+    request.owner = -1;
+    request.busyTime = 0;
+    request.shortOf = -1;
+    request.holderIndex = -1;
+    request.rolledBack = false;
+    cond_init(&request.grantCond);
+}
+
+// adds units of a resource to a request, keeping the needs sorted by id
+// returns false if the request already lists NRES_TYPES resources
+bool addNeed(resourceRequest &request, int id, int units)
+{
+    if (request.numResources >= NRES_TYPES)
+    {
+        return false;
+    }
+    int i = request.numResources;
+    while (i > 0 && request.needs[i-1].id > id)
+    {
+        request.needs[i] = request.needs[i-1];
+        i -= 1;
+    }
+    rsrc need = {.id = id, .total = units, .held = 0};
+    request.needs[i] = need;
+    request.numResources += 1;
+    return true;
+}
+
+// -------------------------------------------
+// poll, queue and incremental functions, these must be called with the resource mutex held
+// only an incremental request holds units before it is granted, the others only ever miss all
+// of their units or none
+
+// checks the resource pool to determine if there are enough resources for a request
+// returns the id of the first resource a request is short of, -1 if it can be granted
+int shortResource(const resourceRequest &request)
+{
+    for (int i = 0; i < request.numResources; ++i)
+    {
+        if (availableResources[request.needs[i].id] < request.needs[i].total - request.needs[i].held)
+        {
+            return request.needs[i].id;
+        }
+    }
+    return -1;
+}
+
+bool canAcquireResources(const resourceRequest &request)
+{
+    for (int i = 0; i < request.numResources; ++i)
+    {
+        // if there is not enough of a certain resource, return false
+        if (availableResources[request.needs[i].id] < request.needs[i].total - request.needs[i].held)
+        {
+            return false;
+        }
+    }
+    // there are enough resources for this request
+    return true;
+}
+
+// takes the resources for a request out of the resource pool
+// canAcquireResources must be checked first
+void takeResources(resourceRequest &request)
+{
+    for (int i = 0; i < request.numResources; ++i)
+    {
+        int id = request.needs[i].id;
+        int units = request.needs[i].total - request.needs[i].held;
+        availableResources[id] -= units;
+        request.needs[i].held = request.needs[i].total;
+        noteHeld(id, units, maxResources[id] - availableResources[id]);
+    } 
+}
+
+// links a request onto the end of a wait list
+void appendWaiting(waitList &list, resourceRequest *request)
+{
+    request->nextWaiting = NULL;
+    request->prevWaiting = list.tail;
+    if (list.tail == NULL)
+    {
+        list.head = request;
+    }
+    else
+    {
+        list.tail->nextWaiting = request;
+    }
+    list.tail = request;
+}
+
+// unlinks a request from a wait list
+void removeWaiting(waitList &list, resourceRequest *request)
+{
+    if (request->prevWaiting == NULL)
+    {
+        list.head = request->nextWaiting;
+    }
+    else
+    {
+        request->prevWaiting->nextWaiting = request->nextWaiting;
+    }
+    if (request->nextWaiting == NULL)
+    {
+        list.tail = request->prevWaiting;
+    }
+    else
+    {
+        request->nextWaiting->prevWaiting = request->prevWaiting;
+    }
+}
+
+// records the resource a request could not be granted for, unless it was already short of one
+void noteShort(resourceRequest &request, int id)
+{
+    if (request.shortOf == -1)
+    {
+        request.shortOf = id;
+    }
+}
+
+// adds a request that can not be granted to the wait list of the resource it is short of
+void waitForResources(resourceRequest &request)
+{
+    request.granted = false;
+    int id = shortResource(request);
+    noteShort(request, id);
+    appendWaiting(blockedOn[id], &request);
+    changeQueued(1);
+}
+
+// grants resources to the waiting requests that a release may have made satisfiable
+// only the requests waiting on a released resource are checked, in arrival order. A list is left
+// as soon as its resource runs out or GRANT_LOOKAHEAD requests in it could not be granted, so the
+// time the mutex is held does not grow with the number of waiting tasks. A request that is now
+// short of a different resource moves to that resource's list
+// the granted requests are added to granted, they are woken after the mutex is released
+void grantWaitingRequests(const resourceRequest &released, vector<resourceRequest *> &granted)
+{
+    for (int i = 0; i < released.numResources; ++i)
+    {
+        int id = released.needs[i].id;
+        int skipped = 0;
+        resourceRequest *waiting = blockedOn[id].head;
+        while (waiting != NULL && availableResources[id] > 0 && skipped < GRANT_LOOKAHEAD)
+        {
+            resourceRequest *next = waiting->nextWaiting;
+            int shortID = shortResource(*waiting);
+            if (shortID == -1)
+            {
+                removeWaiting(blockedOn[id], waiting);
+                changeQueued(-1);
+                takeResources(*waiting);
+                waiting->granted = true;
+                granted.push_back(waiting);
+            }
+            else if (shortID != id)
+            {
+                removeWaiting(blockedOn[id], waiting);
+                appendWaiting(blockedOn[shortID], waiting);
+                skipped += 1;
+            }
+            else
+            {
+                skipped += 1;
+            }
+            waiting = next;
+        }
+    }
+}
+
+// queues a request with the scheduler and grants requests in the order the scheduler picks
+// them until the picked request does not fit, the granted requests are added to granted
+void grantScheduledRequests(resourceRequest *waiting, vector<resourceRequest *> &granted)
+{
+    if (waiting != NULL)
+    {
+        waiting->granted = false;
+        scheduleRequest(waiting);
+        changeQueued(1);
+    }
+    resourceRequest *next;
+    while ((next = nextRequest()) != NULL && shortResource(*next) == -1)
+    {
+        removeNextRequest();
+        changeQueued(-1);
+        takeResources(*next);
+        next->granted = true;
+        granted.push_back(next);
+    }
+    if (waiting != NULL && !waiting->granted)
+    {
+        // it may fit and only be waiting for the requests the scheduler picks first
+        int id = shortResource(*waiting);
+        noteShort(*waiting, id == -1 ? SHORT_OF_TURN : id);
+    }
+}
+
+// wakes the tasks whose requests were granted, other than skip
+// called after the resource mutex is released, except by acquireResources which must wake the
+// others before it waits
+void wakeGranted(const vector<resourceRequest *> &granted, const resourceRequest *skip)
+{
+    for (int i = 0; i < granted.size(); ++i)
+    {
+        if (granted[i] == skip)
+        {
+            continue;
+        }
+        if (granted[i]->grantCallback != NULL)
+        {
+            granted[i]->grantCallback(granted[i]->owner);
+        }
+        else
+        {
+            cond_signal(&granted[i]->grantCond);
+        }
+    }
+}
+
+// -------------------------------------------
+// incremental functions, these must be called with the resource mutex held
+
+// removes a request from the list of waiting requests that hold units
+void removeHolder(resourceRequest &request)
+{
+    if (request.holderIndex < 0)
+    {
+        return;
+    }
+    resourceRequest *last = partialHolders.back();
+    partialHolders[request.holderIndex] = last;
+    last->holderIndex = request.holderIndex;
+    partialHolders.pop_back();
+    request.holderIndex = -1;
+}
+
+// takes the units a request is missing that are in the pool, a rolled back request only takes
+// them if every one is there
+// returns true once the request holds all of its units
+bool takeAvailable(resourceRequest &request)
+{
+    if (canAcquireResources(request))
+    {
+        takeResources(request);
+        removeHolder(request);
+        return true;
+    }
+    if (request.rolledBack)
+    {
+        return false;
+    }
+    bool took = false;
+    for (int i = 0; i < request.numResources; ++i)
+    {
+        int id = request.needs[i].id;
+        int units = min(availableResources[id], request.needs[i].total - request.needs[i].held);
+        availableResources[id] -= units;
+        request.needs[i].held += units;
+        noteHeld(id, units, maxResources[id] - availableResources[id]);
+        took = took || units > 0;
+    }
+    if (took)
+    {
+        if (request.holderIndex < 0)
+        {
+            request.holderIndex = partialHolders.size();
+            partialHolders.push_back(&request);
+        }
+        holdingsChanged = true;
+    }
+    return false;
+}
+
+// takes units for a waiting request listed under resource id, grants it once it holds all of
+// them and otherwise moves it to the list of the resource it is now short of
+void takeForWaiting(resourceRequest *waiting, int id, vector<resourceRequest *> &granted)
+{
+    if (takeAvailable(*waiting))
+    {
+        removeWaiting(blockedOn[id], waiting);
+        changeQueued(-1);
+        waiting->granted = true;
+        waiting->rolledBack = false;
+        granted.push_back(waiting);
+        return;
+    }
+    int shortID = shortResource(*waiting);
+    if (shortID != id)
+    {
+        removeWaiting(blockedOn[id], waiting);
+        appendWaiting(blockedOn[shortID], waiting);
+    }
+}
+
+// hands the units of the resources a request held to the requests waiting for them, in arrival
+// order. An incremental request takes what it can, so a list is left once its resource runs out
+// and no request stays listed under a resource that is in the pool unless it was rolled back
+void giveToWaiting(const resourceRequest &released, vector<resourceRequest *> &granted)
+{
+    for (int i = 0; i < released.numResources; ++i)
+    {
+        int id = released.needs[i].id;
+        resourceRequest *waiting = blockedOn[id].head;
+        while (waiting != NULL && availableResources[id] > 0)
+        {
+            resourceRequest *next = waiting->nextWaiting;
+            takeForWaiting(waiting, id, granted);
+            waiting = next;
+        }
+    }
+}
+
+// reduces the wait-for graph of the waiting requests that hold units and returns the youngest
+// one that is deadlocked, NULL if there is none
+// the units not held by them are in the pool or held by running tasks, which give them back
+resourceRequest *deadlockVictim()
+{
+    int freeable[NRES_TYPES];
+    for (int id = 0; id < resourceNames.size(); ++id)
+    {
+        freeable[id] = maxResources[id];
+    }
+    for (int h = 0; h < partialHolders.size(); ++h)
+    {
+        for (int i = 0; i < partialHolders[h]->numResources; ++i)
+        {
+            freeable[partialHolders[h]->needs[i].id] -= partialHolders[h]->needs[i].held;
+        }
+    }
+    static thread_local vector<bool> finished;
+    finished.assign(partialHolders.size(), false);
+    bool reduced = true;
+    while (reduced)
+    {
+        reduced = false;
+        for (int h = 0; h < partialHolders.size(); ++h)
+        {
+            const resourceRequest &holder = *partialHolders[h];
+            bool canFinish = !finished[h];
+            for (int i = 0; i < holder.numResources && canFinish; ++i)
+            {
+                canFinish = holder.needs[i].total - holder.needs[i].held <= freeable[holder.needs[i].id];
+            }
+            if (canFinish)
+            {
+                // it will run and give back its units
+                for (int i = 0; i < holder.numResources; ++i)
+                {
+                    freeable[holder.needs[i].id] += holder.needs[i].held;
+                }
+                finished[h] = true;
+                reduced = true;
+            }
+        }
+    }
+    resourceRequest *victim = NULL;
+    for (int h = 0; h < partialHolders.size(); ++h)
+    {
+        if (!finished[h] && (victim == NULL || partialHolders[h]->arrival > victim->arrival))
+        {
+            victim = partialHolders[h];
+        }
+    }
+    return victim;
+}
+
+// rolls back deadlocked requests until there is no deadlock, the requests granted the units
+// taken back are added to granted
+// a request left over by the reduction may only be waiting on a deadlock rather than be part of
+// it, so the graph is reduced again after every rollback. A rolled back request never holds
+// units again, so this ends
+void resolveDeadlocks(vector<resourceRequest *> &granted)
+{
+    if (!holdingsChanged)
+    {
+        return;
+    }
+    resourceRequest *victim;
+    while ((victim = deadlockVictim()) != NULL)
+    {
+        removeHolder(*victim);
+        victim->rolledBack = true;
+        deadlocksResolved += 1;
+        for (int i = 0; i < victim->numResources; ++i)
+        {
+            int id = victim->needs[i].id;
+            availableResources[id] += victim->needs[i].held;
+            noteHeld(id, -victim->needs[i].held, maxResources[id] - availableResources[id]);
+            unitsRolledBack += victim->needs[i].held;
+            victim->needs[i].held = 0;
+        }
+        // the victim stays listed under the resource it is short of
+        giveToWaiting(*victim, granted);
+    }
+    holdingsChanged = false;
+}
+
+// takes what is available for a request and, if it is still short, lists it under the resource
+// it is short of and rolls back any deadlock its units caused, which may grant it after all
+// returns true if the request holds all of its units
+bool requestIncremental(resourceRequest &request, vector<resourceRequest *> &granted)
+{
+    request.granted = false;
+    request.rolledBack = false;
+    if (takeAvailable(request))
+    {
+        request.granted = true;
+        return true;
+    }
+    int id = shortResource(request);
+    noteShort(request, id);
+    request.arrival = incrementalArrivals++;
+    appendWaiting(blockedOn[id], &request);
+    changeQueued(1);
+    resolveDeadlocks(granted);
+    return request.granted;
+}
+
+// -------------------------------------------
+// atomic functions
+
+// gives back the units taken for the first count needs of a request and wakes their waiters
+void returnAtomicResources(resourceRequest &request, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        int id = request.needs[i].id;
+        atomicResource &resource = atomicResources[id];
+        int units = resource.units.fetch_add(request.needs[i].total) + request.needs[i].total;
+        noteHeld(id, -request.needs[i].total, maxResources[id] - units);
+        resource.epoch.fetch_add(1);
+        if (resource.waiters.load() > 0)
+        {
+            futexWakeAll(&resource.epoch);
+        }
+        request.needs[i].held = 0;
+    }
+}
+
+// reserves every resource of a request or none of them
+// returns false and sets shortIndex to the need that could not be met if the request failed
+bool tryReserveAtomic(resourceRequest &request, int &shortIndex)
+{
+    for (int i = 0; i < request.numResources; ++i)
+    {
+        atomicResource &resource = atomicResources[request.needs[i].id];
+        int needed = request.needs[i].total;
+        int units = resource.units.load(memory_order_relaxed);
+        do
+        {
+            if (units < needed)
+            {
+                // roll back the resources already taken
+                returnAtomicResources(request, i);
+                shortIndex = i;
+                return false;
+            }
+        } while (!resource.units.compare_exchange_weak(units, units - needed, memory_order_acquire, memory_order_relaxed));
+        request.needs[i].held = needed;
+        noteHeld(request.needs[i].id, needed, maxResources[request.needs[i].id] - (units - needed));
+    }
+    return true;
+}
+
+// blocks until every resource of a request is reserved
+// a waiter registers on the short resource before reading its epoch and trying again, and a
+// release changes the epoch before checking for waiters, so a release can not be missed
+void acquireAtomic(resourceRequest &request)
+{
+    int shortIndex;
+    while (!tryReserveAtomic(request, shortIndex))
+    {
+        noteShort(request, request.needs[shortIndex].id);
+        atomicResource &resource = atomicResources[request.needs[shortIndex].id];
+        resource.waiters.fetch_add(1);
+        int seen = resource.epoch.load();
+        int retryShortIndex;
+        if (tryReserveAtomic(request, retryShortIndex))
+        {
+            resource.waiters.fetch_sub(1);
+            return;
+        }
+        if (retryShortIndex == shortIndex)
+        {
+            // sleep until the resource is released, returns at once if it already was
+            futexWait(&resource.epoch, seen);
+        }
+        resource.waiters.fetch_sub(1);
+    }
+}
+// -------------------------------------------
+
+// blocks until all resources for a request are obtained
+void acquireResources(resourceRequest &request)
+{
+    if (request.numResources == 0)
+    {
+        // task doesn't need any resources
+        return;
+    }
+    if (resourceWaitMode == ATOMIC)
+    {
+        acquireAtomic(request);
+        return;
+    }
+
+    struct timespec lockedAt;
+    if (resourceWaitMode == POLL)
+    {
+        // retry every 10 msec until the resources are available
+        while (true)
+        {   
+            bool success = false;
+            lockResources(&lockedAt);
+            if (canAcquireResources(request))
+            {
+                takeResources(request);
+                success = true;         
+            }
+            else
+            {
+                noteShort(request, shortResource(request));
+            }
+            unlockResources(&lockedAt);
+            if (success) 
+            {
+                return;
+            }
+            usleep(10*1000);
+        }
+    }
+
+    // wait in the queue until a releasing task grants the resources
+    lockResources(&lockedAt);
+    if (resourceWaitMode == INCREMENTAL)
+    {
+        // rolling back a deadlock may grant other requests, which are woken before waiting
+        static thread_local vector<resourceRequest *> granted;
+        granted.clear();
+        requestIncremental(request, granted);
+        wakeGranted(granted, &request);
+        if (!request.granted)
+        {
+            recordResourceHold(&lockedAt);
+            while (!request.granted)
+            {
+                cond_wait(&request.grantCond, &resourceMutex);
+            }
+            clock_gettime(CLOCK_MONOTONIC, &lockedAt);
+        }
+    }
+    else if (resourcePolicy != FIRSTFIT)
+    {
+        // the scheduler decides whether the request goes ahead of the ones already waiting
+        static thread_local vector<resourceRequest *> granted;
+        granted.clear();
+        grantScheduledRequests(&request, granted);
+        wakeGranted(granted, &request);
+        if (!request.granted)
+        {
+            recordResourceHold(&lockedAt);
+            while (!request.granted)
+            {
+                cond_wait(&request.grantCond, &resourceMutex);
+            }
+            clock_gettime(CLOCK_MONOTONIC, &lockedAt);
+        }
+    }
+    else if (canAcquireResources(request))
+    {
+        takeResources(request);
+    }
+    else
+    {
+        waitForResources(request);
+        // the mutex is not held while waiting
+        recordResourceHold(&lockedAt);
+        while (!request.granted)
+        {
+            cond_wait(&request.grantCond, &resourceMutex);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &lockedAt);
+    }
+    unlockResources(&lockedAt);
+}
+
+// tries to obtain all resources for a request without blocking, returns true if they were obtained
+// queue and incremental: a request that can not be granted now joins the wait queue and its
+//        grantCallback is called once a release grants it, the caller must not touch the request
+//        after false is returned
+// poll and atomic: nothing is remembered and the caller must try again later
+bool requestResources(resourceRequest &request)
+{
+    if (request.numResources == 0)
+    {
+        return true;
+    }
+    if (resourceWaitMode == ATOMIC)
+    {
+        int shortIndex;
+        if (tryReserveAtomic(request, shortIndex))
+        {
+            return true;
+        }
+        noteShort(request, request.needs[shortIndex].id);
+        return false;
+    }
+
+    struct timespec lockedAt;
+    bool success = false;
+    static thread_local vector<resourceRequest *> granted;
+    granted.clear();
+    lockResources(&lockedAt);
+    if (resourceWaitMode == INCREMENTAL)
+    {
+        success = requestIncremental(request, granted);
+    }
+    else if (resourceWaitMode == QUEUE && resourcePolicy != FIRSTFIT)
+    {
+        // the scheduler decides whether the request goes ahead of the ones already waiting
+        grantScheduledRequests(&request, granted);
+        success = request.granted;
+    }
+    else if (canAcquireResources(request))
+    {
+        takeResources(request);
+        success = true;
+    }
+    else if (resourceWaitMode == QUEUE)
+    {
+        waitForResources(request);
+    }
+    else
+    {
+        noteShort(request, shortResource(request));
+    }
+    unlockResources(&lockedAt);
+
+    // the caller learns about its own grant from the return value
+    wakeGranted(granted, &request);
+    return success;
+}
+
+// returns all resources held for a request to the resource pool
+void releaseResources(resourceRequest &request)
+{
+    if (resourceWaitMode == ATOMIC)
+    {
+        returnAtomicResources(request, request.numResources);
+        return;
+    }
+
+    struct timespec lockedAt;
+    lockResources(&lockedAt);
+    for (int i = 0; i < request.numResources; ++i)
+    {
+        int id = request.needs[i].id;
+        availableResources[id] += request.needs[i].held;
+        noteHeld(id, -request.needs[i].held, maxResources[id] - availableResources[id]);
+        request.needs[i].held = 0;
+    }
+    // reused by every release from this thread so it only allocates while growing
+    static thread_local vector<resourceRequest *> granted;
+    granted.clear();
+    if (resourceWaitMode == QUEUE && resourcePolicy != FIRSTFIT)
+    {
+        grantScheduledRequests(NULL, granted);
+    }
+    else if (resourceWaitMode == QUEUE)
+    {
+        grantWaitingRequests(request, granted);
+    }
+    else if (resourceWaitMode == INCREMENTAL)
+    {
+        giveToWaiting(request, granted);
+        resolveDeadlocks(granted);
+    }
+    unlockResources(&lockedAt);
+
+    // wake only the tasks that were granted resources
+    wakeGranted(granted, NULL);
+}
@@ -0,0 +1,117 @@
+#ifndef RESOURCES_H
+#define RESOURCES_H
+
+#include "libraries.h"
+#include "scheduler.h"
+
+#include <atomic>
+
+#define NRES_TYPES 10
+#define GRANT_LOOKAHEAD 64 // queue: most waiting requests a release checks past the ones it grants, per resource
+#define SHORT_OF_TURN NRES_TYPES // shortOf of a request that only waited for the scheduler to pick it
+
+// how a task that cannot get its resources waits for them
+enum waitMode {POLL, QUEUE, ATOMIC, INCREMENTAL};
+const string WAITMODENAME[4] = {"poll", "queue", "atomic", "incremental"};
+
+// resource names are interned to ids when the input file is read so the
+// acquire and release critical sections only index flat arrays
+struct rsrc 
+{
+    int id;     // index into resourceNames
+    int total;
+    int held;
+};
+
+// the resources needed by a task and how it is woken once they are granted
+struct resourceRequest
+{
+    rsrc needs[NRES_TYPES];         // sorted by id
+    int numResources;
+    pthread_cond_t grantCond;       // queue: signalled when the request has been granted
+    bool granted;
+    void (*grantCallback)(int owner); // queue: called instead of signalling grantCond if set
+    int owner;                      // passed to grantCallback
+    resourceRequest *prevWaiting;   // queue: neighbours in the wait list the request is on
+    resourceRequest *nextWaiting;
+    int busyTime;                   // sbtf: msec the resources are held once granted
+    long long arrival;              // scheduler: order the request started waiting in
+    long long scheduleKey;          // scheduler: requests with lower keys are served first
+    int shortOf;                    // resource the request was first short of, the owner sets -1
+                                    // before acquiring to find out whether and for what it waited
+    int holderIndex;                // incremental: index in the list of waiting requests holding
+                                    // units, -1 if it holds none
+    bool rolledBack;                // incremental: the deadlock detector took back its units, it now
+                                    // waits for all of them at once
+};
+
+/* RESOURCE POOL
+Every request but an incremental one is all-or-nothing: a task either gets all of its resources
+or none of them.
+
+poll and queue keep the pool in flat arrays behind a single mutex. In queue mode a task that
+cannot run waits on its own condition variable, listed under a resource it is short of, and a
+releasing task grants resources to the tasks waiting on what it released that can now run,
+in arrival order. Only the granted tasks are woken. With any scheduling policy but firstfit the
+waiting requests are kept by the scheduler instead, see scheduler.h.
+
+atomic has no global lock. Each resource is an atomic counter on its own cache line and a
+request is reserved with a CAS on each counter in id order, giving back what it took if a later
+counter is short. A task that cannot run sleeps on a futex for the resource that was short and
+only releases of that resource wake it, so tasks with disjoint needs never touch the same
+cache line. There is no wait queue so the order in which waiting tasks are served is not fair.
+
+incremental waits in the queue's wait lists, but a waiting task takes every unit it still needs
+as soon as it is available and holds on to it, so tasks can deadlock. Whenever a waiting task
+takes units without completing its request, the waiting tasks that hold units are checked for a
+deadlock by reducing the wait-for graph: a task whose missing units could all be freed by the
+pool, the running tasks and the tasks already reduced will finish, and any task left over is
+deadlocked. The youngest deadlocked task is rolled back: its units go back to the pool, are
+handed to the tasks waiting for them, and it then waits for all of its resources at once so it
+can never be part of another deadlock.
+
+Once a clock is set with setPoolClock, every change of the units held of a resource and of the
+number of queued requests is recorded against it, so their time weighted means over a run are
+exact however short the run is. A change of a level by delta at time t adds -delta * t to its
+total, so the total plus the current level times now is the integral of the level up to now.
+*/
+extern vector<string> resourceNames;        // resource names, indexed by id
+extern int maxResources[NRES_TYPES];        // units of each resource declared in the input file
+extern waitMode resourceWaitMode;
+extern schedulePolicy resourcePolicy;       // queue: which waiting request is granted released resources
+extern long long resourceMutexHoldNsec;     // poll/queue: total time the resource mutex was held
+extern long long resourceMutexHolds;        // poll/queue: number of times the resource mutex was held
+extern long long deadlocksResolved;         // incremental: number of requests rolled back
+extern long long unitsRolledBack;           // incremental: units taken back from them
+
+// resource pool function declarations
+void initResourcePool(waitMode mode, schedulePolicy policy);
+
+int addResource(string name, int units);
+
+int availableUnits(int id);
+
+void heldUnits(int held[NRES_TYPES]);
+
+int queuedRequests();
+
+void setPoolClock(long long (*clockUsec)());
+
+void poolLevelUsec(long long heldUsec[NRES_TYPES], long long &queuedUsec);
+
+int heldPeak(int id);
+
+int queuedPeak();
+
+void initRequest(resourceRequest &request);
+
+bool addNeed(resourceRequest &request, int id, int units);
+
+void acquireResources(resourceRequest &request);
+
+bool requestResources(resourceRequest &request);
+
+void releaseResources(resourceRequest &request);
+// end resource pool function declarations
+
+#endif
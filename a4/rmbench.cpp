@@ -0,0 +1,195 @@
+/*
+Benchmark for the a4rmd resource manager.
+
+Starts a manager in a child process, then for each number of client processes and batch size
+every client acquires and releases requests for a fixed time and the total grants per second
+are reported. A client keeps a batch of acquires outstanding: it releases each grant as soon
+as it arrives and asks for another request in its place, and it only writes once it has handled
+every reply it has read, so the releases and acquires for a batch of replies go out in one
+write. Each request needs 1 unit of 2 of RESOURCES resources with UNITS units each, so requests
+contend once enough are outstanding.
+
+usage: rmbench [msecPerRun]
+*/
+
+#include "libraries.h"
+#include "resources.h"
+#include "manager.h"
+
+#include <signal.h>
+#include <sys/wait.h>
+
+#define RESOURCES 4
+#define UNITS 16
+#define CONNECT_RETRIES 100 // times a client tries to connect while the manager starts
+
+// client counts and batch sizes measured by the benchmark
+const int CLIENTCOUNTS[7] = {1, 2, 4, 8, 16, 32, 64};
+const int BATCHSIZES[2] = {1, 8};
+
+// returns the current time in msec
+long long currentMsec()
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return now.tv_sec * 1000LL + now.tv_usec / 1000;
+}
+
+// queues an acquire of 1 unit of each of 2 different resources
+void queueRandomAcquire(managerConnection &conn)
+{
+    resourceRequest request;
+    request.numResources = 0;
+    int first = rand() % RESOURCES;
+    addNeed(request, first, 1);
+    addNeed(request, (first + 1 + rand() % (RESOURCES - 1)) % RESOURCES, 1);
+    queueAcquire(conn, request);
+}
+
+// connects, waits for the start byte, acquires and releases batches for msec and writes the
+// number of grants to resultfd, runs in a client process
+void runClient(string path, int batch, int msec, int startfd, int resultfd)
+{
+    managerConnection conn;
+    bool connected = false;
+    for (int attempt = 0; attempt < CONNECT_RETRIES && !connected; ++attempt)
+    {
+        connected = connectManager(conn, path);
+        if (!connected)
+        {
+            usleep(10 * 1000);
+        }
+    }
+    char go;
+    long long grants = -1;
+    if (connected && read(startfd, &go, 1) == 1)
+    {
+        srand(getpid());
+        grants = 0;
+        for (int b = 0; b < batch; ++b)
+        {
+            queueRandomAcquire(conn);
+        }
+        long long end = currentMsec() + msec;
+        managerMessage reply;
+        while (currentMsec() < end)
+        {
+            // nothing is held while waiting, so clients can not deadlock each other
+            if ((conn.received.size() < sizeof(reply) && !flushManager(conn)) || !readManagerMessage(conn, reply))
+            {
+                grants = -1;
+                break;
+            }
+            if (reply.op == MANAGER_GRANTED)
+            {
+                queueRelease(conn, reply.requestId);
+                queueRandomAcquire(conn);
+                grants += 1;
+            }
+        }
+        closeManager(conn);
+    }
+    if (write(resultfd, &grants, sizeof(grants)) != sizeof(grants))
+    {
+        _exit(1);
+    }
+    _exit(0);
+}
+
+// runs one configuration and returns the grants per second, -1 if a client failed
+double runBenchmark(string path, int numClients, int batch, int msec)
+{
+    int startPipe[2], resultPipe[2];
+    if (pipe(startPipe) < 0 || pipe(resultPipe) < 0)
+    {
+        return -1;
+    }
+    // nothing buffered is written twice by the clients
+    fflush(stdout);
+    for (int i = 0; i < numClients; ++i)
+    {
+        if (fork() == 0)
+        {
+            close(startPipe[1]);
+            close(resultPipe[0]);
+            runClient(path, batch, msec, startPipe[0], resultPipe[1]);
+        }
+    }
+    close(startPipe[0]);
+    close(resultPipe[1]);
+
+    // every client is connected or gave up once the start bytes are read
+    string go(numClients, 'g');
+    if (write(startPipe[1], go.data(), numClients) != numClients)
+    {
+        return -1;
+    }
+    long long total = 0;
+    bool failed = false;
+    for (int i = 0; i < numClients; ++i)
+    {
+        long long grants;
+        failed = failed || read(resultPipe[0], &grants, sizeof(grants)) != sizeof(grants) || grants < 0;
+        total += max(grants, 0LL);
+    }
+    for (int i = 0; i < numClients; ++i)
+    {
+        wait(NULL);
+    }
+    close(startPipe[1]);
+    close(resultPipe[0]);
+    return failed ? -1 : total * 1000.0 / msec;
+}
+
+int main(int argc, char *argv[])
+{
+    int msec = 500;
+    if (argc == 2)
+    {
+        msec = atoi(argv[1]);
+    }
+
+    // the manager runs in a child until it is sent SIGTERM
+    ostringstream path;
+    path << "/tmp/rmbench-" << getpid() << ".sock";
+    initResourcePool(QUEUE, FIFO);
+    for (int id = 0; id < RESOURCES; ++id)
+    {
+        ostringstream name;
+        name << "R" << id;
+        addResource(name.str(), UNITS);
+    }
+    int listenfd = openManagerSocket(path.str());
+    if (listenfd < 0)
+    {
+        cout << "Unable to listen on " << path.str() << endl;
+        return 1;
+    }
+    pid_t manager = fork();
+    if (manager == 0)
+    {
+        _exit(runManager(listenfd, MANAGER_LEASE_MSEC) ? 0 : 1);
+    }
+    close(listenfd);
+
+    printf("Measuring %d msec per run, %d resources of %d units, 2 units per request\n\n", msec, RESOURCES, UNITS);
+    printf("clients  batch   grants/sec\n");
+    for (int c = 0; c < 7; ++c)
+    {
+        for (int b = 0; b < 2; ++b)
+        {
+            double rate = runBenchmark(path.str(), CLIENTCOUNTS[c], BATCHSIZES[b], msec);
+            if (rate < 0)
+            {
+                printf("%-8d %-5d failed\n", CLIENTCOUNTS[c], BATCHSIZES[b]);
+                continue;
+            }
+            printf("%-8d %-5d %12.0f\n", CLIENTCOUNTS[c], BATCHSIZES[b], rate);
+        }
+    }
+
+    kill(manager, SIGTERM);
+    waitpid(manager, NULL, 0);
+    unlink(path.str().c_str());
+    return 0;
+}
@@ -0,0 +1,177 @@
+#include "scheduler.h"
+#include "resources.h"
+
+#include <algorithm>
+
+schedulePolicy policy = FIRSTFIT;
+vector<resourceRequest *> scheduled;    // a heap for fifo, sbtf and priority, unordered for lottery
+long long arrivals = 0;                 // requests scheduled so far, the arrival order
+vector<long long> ticketTree;           // lottery: fenwick tree of the tickets of scheduled[i]
+long long totalTickets = 0;             // lottery: tickets of every scheduled request
+int drawnIndex = -1;                    // lottery: the request returned by the last nextRequest
+unsigned int lotterySeed = LOTTERY_SEED;
+
+// orders the heap so the request to serve next is on top
+bool servedLater(const resourceRequest *a, const resourceRequest *b)
+{
+    if (a->scheduleKey != b->scheduleKey)
+    {
+        return a->scheduleKey > b->scheduleKey;
+    }
+    return a->arrival > b->arrival;
+}
+
+// returns the units a request needs, its priority
+int unitsNeeded(const resourceRequest *request)
+{
+    int units = 0;
+    for (int i = 0; i < request->numResources; ++i)
+    {
+        units += request->needs[i].total;
+    }
+    return units;
+}
+
+// returns the lottery tickets of a request, every request holds at least one
+int ticketsHeld(const resourceRequest *request)
+{
+    return 1 + unitsNeeded(request);
+}
+
+// returns the policy with the given name, -1 if there is none
+int policyFromName(string name)
+{
+    for (int i = FIRSTFIT; i <= LOTTERY; ++i)
+    {
+        if (name.compare(POLICYNAME[i]) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// -------------------------------------------
+// lottery ticket tree, finds the holder of a ticket in O(log waiting requests)
+// adds tickets to the request at index
+void addTickets(int index, long long tickets)
+{
+    for (int i = index + 1; i <= (int) ticketTree.size(); i += i & (-i))
+    {
+        ticketTree[i-1] += tickets;
+    }
+}
+
+// rebuilds the tree with room for at least size requests
+void growTicketTree(int size)
+{
+    ticketTree.assign(max(16, 2 * size), 0);
+    for (int i = 0; i < (int) scheduled.size(); ++i)
+    {
+        addTickets(i, scheduled[i]->scheduleKey);
+    }
+}
+
+// returns the index of the request holding ticket, counting tickets from the first request
+int ticketHolder(long long ticket)
+{
+    int index = 0;
+    int step = 1;
+    while (step * 2 <= (int) ticketTree.size())
+    {
+        step *= 2;
+    }
+    for (; step > 0; step /= 2)
+    {
+        if (index + step <= (int) ticketTree.size() && ticketTree[index+step-1] <= ticket)
+        {
+            index += step;
+            ticket -= ticketTree[index-1];
+        }
+    }
+    return index;
+}
+// -------------------------------------------
+
+// empties the scheduler and selects its policy
+void initScheduler(schedulePolicy newPolicy)
+{
+    policy = newPolicy;
+    scheduled.clear();
+    arrivals = 0;
+    ticketTree.clear();
+    totalTickets = 0;
+    drawnIndex = -1;
+    lotterySeed = LOTTERY_SEED;
+}
+
+// adds a waiting request to the scheduler, must be called with the resource mutex held
+void scheduleRequest(resourceRequest *request)
+{
+    request->arrival = arrivals++;
+    switch (policy)
+    {
+        case SBTF:
+            request->scheduleKey = request->busyTime;
+            break;
+        case PRIORITY:
+            request->scheduleKey = request->arrival - (long long) unitsNeeded(request) * AGING_REQUESTS;
+            break;
+        case LOTTERY:
+            // the key of a lottery request is the number of tickets it holds
+            request->scheduleKey = ticketsHeld(request);
+            scheduled.push_back(request);
+            if (scheduled.size() > ticketTree.size())
+            {
+                growTicketTree(scheduled.size());
+            }
+            else
+            {
+                addTickets(scheduled.size() - 1, request->scheduleKey);
+            }
+            totalTickets += request->scheduleKey;
+            return;
+        default:
+            request->scheduleKey = request->arrival;
+            break;
+    }
+    scheduled.push_back(request);
+    push_heap(scheduled.begin(), scheduled.end(), servedLater);
+}
+
+// returns the request the policy serves next without removing it, NULL if none are waiting
+// must be called with the resource mutex held
+resourceRequest *nextRequest()
+{
+    if (scheduled.empty())
+    {
+        return NULL;
+    }
+    if (policy != LOTTERY)
+    {
+        return scheduled.front();
+    }
+
+    // draw a ticket and find the request holding it
+    drawnIndex = ticketHolder(rand_r(&lotterySeed) % totalTickets);
+    return scheduled[drawnIndex];
+}
+
+// removes the request returned by the last call to nextRequest
+// must be called with the resource mutex held
+void removeNextRequest()
+{
+    if (policy != LOTTERY)
+    {
+        pop_heap(scheduled.begin(), scheduled.end(), servedLater);
+        scheduled.pop_back();
+        return;
+    }
+    // move the last request into the drawn one's place
+    int last = scheduled.size() - 1;
+    totalTickets -= scheduled[drawnIndex]->scheduleKey;
+    addTickets(drawnIndex, scheduled[last]->scheduleKey - scheduled[drawnIndex]->scheduleKey);
+    addTickets(last, -scheduled[last]->scheduleKey);
+    scheduled[drawnIndex] = scheduled[last];
+    scheduled.pop_back();
+}
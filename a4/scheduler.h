@@ -0,0 +1,45 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "libraries.h"
+
+struct resourceRequest;
+
+// which waiting request released resources go to in queue mode
+enum schedulePolicy {FIRSTFIT, FIFO, SBTF, PRIORITY, LOTTERY};
+const string POLICYNAME[5] = {"firstfit", "fifo", "sbtf", "priority", "lottery"};
+
+#define AGING_REQUESTS 16   // priority: later arrivals a waiting request is allowed to be passed by per unit it needs
+#define LOTTERY_SEED 379
+
+/* SCHEDULER
+firstfit is not handled here: each release grants every request waiting on what it released
+that fits, in arrival order, so small requests keep passing large ones.
+
+The other policies keep every waiting request in one queue, and releases grant the request
+the policy picks for as long as it fits. A picked request that does not fit blocks the
+requests behind it, so the released resources are kept for it instead of going to smaller ones.
+    fifo:     arrival order
+    sbtf:     shortest busy time first, ties in arrival order
+    priority: requests needing more units go first, but a request can only be passed by
+              AGING_REQUESTS later arrivals per unit it needs, so small requests age in too
+    lottery:  a random draw weighted by one more than the units each request needs, redrawn
+              on every release
+fifo, sbtf and priority order a heap by a key fixed when the request arrives (aging by
+arrivals rather than by time keeps the order fixed), lottery finds the winning ticket in a
+fenwick tree of the tickets each waiting request holds.
+*/
+
+// scheduler function declarations
+int policyFromName(string name);
+
+void initScheduler(schedulePolicy policy);
+
+void scheduleRequest(resourceRequest *request);
+
+resourceRequest *nextRequest();
+
+void removeNextRequest();
+// end scheduler function declarations
+
+#endif
@@ -0,0 +1,149 @@
+#include "trace.h"
+#include "locks.h"
+#include "resources.h"
+#include "executor.h"
+
+#include <algorithm>
+
+bool tracing = false;
+pthread_mutex_t traceMutex = PTHREAD_MUTEX_INITIALIZER;    // guards traceBuffers
+vector<vector<traceEvent> *> traceBuffers;                // the buffer of every thread that recorded
+atomic<long long> droppedEvents(0);
+
+// starts recording, must be called before any task runs
+void enableTrace()
+{
+    tracing = true;
+}
+
+bool traceEnabled()
+{
+    return tracing;
+}
+
+// records an event for a task in the calling thread's buffer
+void recordTrace(int taskIndex, traceKind kind, int arg)
+{
+    if (!tracing)
+    {
+        return;
+    }
+    static thread_local vector<traceEvent> *buffer = NULL;
+    if (buffer == NULL)
+    {
+        // the buffer outlives the thread so it can be written at exit
+        buffer = new vector<traceEvent>();
+        buffer->reserve(4096);
+        mutex_lock(&traceMutex);
+        traceBuffers.push_back(buffer);
+        mutex_unlock(&traceMutex);
+    }
+    if (buffer->size() >= TRACE_MAX_EVENTS)
+    {
+        droppedEvents.fetch_add(1, memory_order_relaxed);
+        return;
+    }
+    traceEvent event;
+    event.usec = executorTimeUsec();
+    event.taskIndex = taskIndex;
+    event.kind = kind;
+    event.arg = arg;
+    buffer->push_back(event);
+}
+
+// orders events by task, then by time, then in the order a task goes through them
+bool earlierEvent(const traceEvent &a, const traceEvent &b)
+{
+    if (a.taskIndex != b.taskIndex)
+    {
+        return a.taskIndex < b.taskIndex;
+    }
+    return a.usec < b.usec;
+}
+
+// returns what a task waited for, as named in the trace
+string shortOfName(int id)
+{
+    if (id == SHORT_OF_TURN)
+    {
+        return "its turn";
+    }
+    if (id >= 0 && id < resourceNames.size())
+    {
+        return resourceNames[id];
+    }
+    return "nothing";
+}
+
+// writes every recorded event to fileName as a Chrome trace, must be called once the tasks
+// have stopped, returns false if the file can not be written
+bool writeTrace(string fileName, const vector<string> &taskNames)
+{
+    FILE *fp = fopen(fileName.c_str(), "w");
+    if (fp == NULL)
+    {
+        return false;
+    }
+
+    // each task's events were recorded by whichever threads ran it
+    vector<traceEvent> events;
+    long long firstUsec = -1, lastUsec = 0;
+    for (int i = 0; i < traceBuffers.size(); ++i)
+    {
+        events.insert(events.end(), traceBuffers[i]->begin(), traceBuffers[i]->end());
+    }
+    stable_sort(events.begin(), events.end(), earlierEvent);
+    for (int i = 0; i < events.size(); ++i)
+    {
+        firstUsec = (firstUsec < 0) ? events[i].usec : min(firstUsec, events[i].usec);
+        lastUsec = max(lastUsec, events[i].usec);
+    }
+
+    fprintf(fp, "{\"displayTimeUnit\": \"ms\", \"otherData\": {\"droppedEvents\": %lld}, \"traceEvents\": [\n", droppedEvents.load());
+    fprintf(fp, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"a4tasks\"}}");
+    for (int t = 0; t < taskNames.size(); ++t)
+    {
+        fprintf(fp, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s\"}}", t, taskNames[t].c_str());
+    }
+
+    // a state lasts until the task's next state or the end of the task
+    const char *STATESLICE[3] = {"WAIT", "RUN", "IDLE"};
+    for (int i = 0; i < events.size(); ++i)
+    {
+        const traceEvent &event = events[i];
+        long long ts = event.usec - firstUsec;
+        if (event.kind == TRACE_GRANT)
+        {
+            fprintf(fp, ",\n{\"name\": \"grant\", \"ph\": \"i\", \"s\": \"t\", \"pid\": 1, \"tid\": %d, \"ts\": %lld, \"args\": {\"short of\": \"%s\"}}",
+                    event.taskIndex, ts, shortOfName(event.arg).c_str());
+        }
+        if (event.kind > TRACE_IDLE)
+        {
+            continue;
+        }
+        long long endUsec = lastUsec;
+        string waitedFor;
+        for (int j = i + 1; j < events.size() && events[j].taskIndex == event.taskIndex; ++j)
+        {
+            if (events[j].kind == TRACE_GRANT && event.kind == TRACE_WAIT && waitedFor.empty())
+            {
+                waitedFor = shortOfName(events[j].arg);
+            }
+            if (events[j].kind != TRACE_GRANT)
+            {
+                endUsec = events[j].usec;
+                break;
+            }
+        }
+        fprintf(fp, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %lld, \"dur\": %lld",
+                STATESLICE[event.kind], event.taskIndex, ts, endUsec - event.usec);
+        if (event.kind == TRACE_WAIT)
+        {
+            fprintf(fp, ", \"args\": {\"short of\": \"%s\"}", waitedFor.empty() ? "nothing" : waitedFor.c_str());
+        }
+        fprintf(fp, "}");
+    }
+    fprintf(fp, "\n]}\n");
+    fclose(fp);
+    return true;
+}
@@ -0,0 +1,37 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "libraries.h"
+
+#define TRACE_MAX_EVENTS (4 << 20)  // most events kept by one thread, later ones are counted and dropped
+
+// what a trace event records, the first three are the task states
+enum traceKind {TRACE_WAIT, TRACE_RUN, TRACE_IDLE, TRACE_GRANT, TRACE_DONE};
+
+/* TRACE
+Every state change of a task and every grant of its resources is appended to a buffer owned
+by the thread that made it, so recording takes no lock and shares no cache lines. A buffer is
+only registered, under a mutex, the first time its thread records an event. At exit the
+buffers are merged and written as a Chrome trace (load it in chrome://tracing or
+ui.perfetto.dev): one row per task with a slice for every WAIT, RUN and IDLE period, the WAIT
+slices naming the resource the task was short of, and an instant event for every grant.
+*/
+struct traceEvent
+{
+    long long usec;     // executor time of the event, virtual in virtual time
+    int taskIndex;
+    short kind;         // a traceKind
+    short arg;          // TRACE_GRANT: the resource the task was short of, see resourceRequest.shortOf
+};
+
+// trace function declarations
+void enableTrace();
+
+bool traceEnabled();
+
+void recordTrace(int taskIndex, traceKind kind, int arg);
+
+bool writeTrace(string fileName, const vector<string> &taskNames);
+// end trace function declarations
+
+#endif
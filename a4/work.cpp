@@ -0,0 +1,164 @@
+#include "work.h"
+#include "output.h"
+
+#include <math.h>
+
+workMode currentWorkMode = SLEEP;
+long long chunkIterations[5];           // kernel iterations that take about WORK_CHECK_USEC
+char *resourceBuffers[NRES_TYPES];      // shared: one buffer for each resource
+atomic<long long> requestedUsec(0);     // busy time asked for
+atomic<long long> cpuUsec(0);           // CPU time used by the busy periods
+atomic<long long> wallUsec(0);          // time the busy periods took
+atomic<long long> workSink(0);          // keeps the compiler from removing the kernels
+
+// returns the CPU time used by the calling thread in microseconds
+long long threadCpuUsec()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+// returns the monotonic time in microseconds
+long long wallClockUsec()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+// reads and writes a buffer one cache line at a time starting from offset, returns the new offset
+long long touchBuffer(char *buffer, long long bytes, long long offset, long long lines)
+{
+    long long sum = 0;
+    for (long long i = 0; i < lines; ++i)
+    {
+        buffer[offset] += 1;
+        sum += buffer[offset];
+        offset += 64;
+        if (offset >= bytes)
+        {
+            offset = 0;
+        }
+    }
+    workSink.fetch_add(sum, memory_order_relaxed);
+    return offset;
+}
+
+// runs one chunk of iterations of a kernel
+void runKernel(workMode mode, long long iterations, const resourceRequest *request)
+{
+    static thread_local vector<char> threadBuffer;
+    static thread_local long long threadOffset = 0;
+    if (mode == SPIN)
+    {
+        unsigned long long x = 379;
+        for (long long i = 0; i < iterations; ++i)
+        {
+            x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+        }
+        workSink.fetch_add(x, memory_order_relaxed);
+    }
+    else if (mode == COMPUTE)
+    {
+        double x = 1.0;
+        for (long long i = 0; i < iterations; ++i)
+        {
+            x = sqrt(x * 1.0000001 + 0.5);
+        }
+        workSink.fetch_add((long long) x, memory_order_relaxed);
+    }
+    else if (mode == MEM || request == NULL || request->numResources == 0)
+    {
+        if (threadBuffer.empty())
+        {
+            threadBuffer.resize(WORK_BUFFER_BYTES);
+        }
+        threadOffset = touchBuffer(&threadBuffer[0], WORK_BUFFER_BYTES, threadOffset, iterations);
+    }
+    else
+    {
+        // shared: spread the chunk over the buffers of the resources held
+        long long lines = max(1LL, iterations / request->numResources);
+        for (int i = 0; i < request->numResources; ++i)
+        {
+            threadOffset = touchBuffer(resourceBuffers[request->needs[i].id], RESOURCE_BUFFER_BYTES,
+                                       threadOffset % RESOURCE_BUFFER_BYTES, lines);
+        }
+    }
+}
+
+// selects the work mode with the given name, returns false if there is none
+bool workModeFromName(string name, workMode &mode)
+{
+    for (int i = SLEEP; i <= SHARED; ++i)
+    {
+        if (name.compare(WORKMODENAME[i]) == 0)
+        {
+            mode = (workMode) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// selects the work mode, allocates the buffers it needs and sizes its chunks
+void initWork(workMode mode)
+{
+    currentWorkMode = mode;
+    if (mode == SLEEP)
+    {
+        return;
+    }
+    for (int id = 0; id < NRES_TYPES; ++id)
+    {
+        resourceBuffers[id] = new char[RESOURCE_BUFFER_BYTES]();
+    }
+
+    // time a run of a known number of iterations and scale it to WORK_CHECK_USEC
+    long long iterations = 1024;
+    long long start = threadCpuUsec();
+    long long elapsed = 0;
+    while ((elapsed = threadCpuUsec() - start) < 2000)
+    {
+        runKernel(mode, iterations, NULL);
+        iterations *= 2;
+    }
+    // iterations - 1024 iterations were run in elapsed usec
+    chunkIterations[mode] = max(1LL, (iterations - 1024) * WORK_CHECK_USEC / max(1LL, elapsed));
+}
+
+// holds the CPU for busyMsec of thread CPU time, or sleeps for it in sleep mode
+void doWork(int busyMsec, const resourceRequest &request)
+{
+    long long wallStart = wallClockUsec();
+    long long cpuStart = threadCpuUsec();
+    if (currentWorkMode == SLEEP)
+    {
+        usleep(busyMsec * 1000);
+    }
+    else
+    {
+        long long until = cpuStart + busyMsec * 1000LL;
+        while (threadCpuUsec() < until)
+        {
+            runKernel(currentWorkMode, chunkIterations[currentWorkMode], &request);
+        }
+    }
+    requestedUsec.fetch_add(busyMsec * 1000LL, memory_order_relaxed);
+    cpuUsec.fetch_add(threadCpuUsec() - cpuStart, memory_order_relaxed);
+    wallUsec.fetch_add(wallClockUsec() - wallStart, memory_order_relaxed);
+}
+
+// prints the busy time asked for against the CPU time and wall time the busy periods took
+void printWorkSummary()
+{
+    long long requested = requestedUsec.load();
+    ostringstream out;
+    out << fixed << setprecision(1);
+    out << "Busy work= " << WORKMODENAME[currentWorkMode] <<
+           ", requested= " << requested / 1000 << " msec" <<
+           ", CPU= " << cpuUsec.load() / 1000 << " msec (" << (requested > 0 ? 100.0 * cpuUsec.load() / requested : 0) << "%)" <<
+           ", wall= " << wallUsec.load() / 1000 << " msec (" << (requested > 0 ? 100.0 * wallUsec.load() / requested : 0) << "%)" << endl;
+    writeOutput(out.str());
+}
@@ -0,0 +1,39 @@
+#ifndef WORK_H
+#define WORK_H
+
+#include "libraries.h"
+#include "resources.h"
+
+#define WORK_CHECK_USEC 20              // about how often a kernel checks whether it is done
+#define WORK_BUFFER_BYTES (2 << 20)     // mem: buffer of each thread, larger than most L2 caches
+#define RESOURCE_BUFFER_BYTES (256 << 10) // shared: buffer of each resource
+
+// what a task does while it holds its resources
+enum workMode {SLEEP, SPIN, COMPUTE, MEM, SHARED};
+const string WORKMODENAME[5] = {"sleep", "spin", "compute", "mem", "shared"};
+
+/* WORK
+sleep is the original behaviour: the busy time passes in usleep and only lock waits are
+measured. The other modes use the CPU until the thread has run for the busy time, so tasks
+compete for cores and caches as well as resources:
+    spin:    integer arithmetic in registers
+    compute: a dependent chain of floating point operations
+    mem:     reads and writes a WORK_BUFFER_BYTES buffer of the thread, memory bandwidth bound
+    shared:  reads and writes the RESOURCE_BUFFER_BYTES buffer of every resource held, so
+             tasks sharing a resource move its cache lines between cores
+Each kernel runs in chunks sized when the program starts to take about WORK_CHECK_USEC and
+reads the thread CPU clock after every chunk. The CPU time and the wall time each busy period
+actually took are added up so they can be compared with the busy time asked for.
+*/
+
+// work function declarations
+bool workModeFromName(string name, workMode &mode);
+
+void initWork(workMode mode);
+
+void doWork(int busyMsec, const resourceRequest &request);
+
+void printWorkSummary();
+// end work function declarations
+
+#endif